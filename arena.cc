@@ -0,0 +1,57 @@
+#include "arena.h"
+
+Arena::~Arena()
+{
+    for (Block *block : blocks) {
+        delete[] block->data;
+        delete block;
+    }
+}
+
+/**
+ * @brief Allocate bytes aligned for pointers and 64-bit keys (nodes and values). Every claim is rounded up
+ *        to the alignment, so the next one starts aligned too.
+ */
+char *Arena::allocateAligned(size_t bytes)
+{
+    const size_t align = alignof(void *) > 8 ? alignof(void *) : 8;
+    bytes = (bytes + align - 1) & ~(align - 1);
+    while (true) {
+        Block *block = current.load(std::memory_order_acquire);
+        if (block != nullptr) {
+            size_t start = block->used.fetch_add(bytes, std::memory_order_relaxed);
+            if (start + bytes <= block->size) return block->data + start;
+        }
+        char *result = allocateFallback(block, bytes);
+        if (result != nullptr) return result;
+    }
+}
+
+/**
+ * @brief The current block is too small. Big requests get a block of their own, so the rest of
+ *        the current block is not wasted; otherwise start a new block.
+ * @param full the block found too small
+ * @return nullptr if another thread started a new block meanwhile: try that one
+ */
+char *Arena::allocateFallback(Arena::Block *full, size_t bytes)
+{
+    std::lock_guard<std::mutex> lk(blockLock);
+    if (bytes > ARENA_BLOCK_SIZE / 4) return allocateNewBlock(bytes, bytes)->data;
+    if (current.load(std::memory_order_relaxed) != full) return nullptr;
+
+    /* A new block starts aligned (new[] returns memory aligned for any type) */
+    Block *block = allocateNewBlock(ARENA_BLOCK_SIZE, bytes);
+    current.store(block, std::memory_order_release);
+    return block->data;
+}
+
+/**
+ * @brief Add a block of bytes, the first used of them already claimed. blockLock is held.
+ */
+Arena::Block *Arena::allocateNewBlock(size_t bytes, size_t used)
+{
+    Block *block = new Block(new char[bytes], bytes, used);
+    blocks.push_back(block);
+    usage += bytes;
+    return block;
+}
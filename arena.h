@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)    //Allocations are carved from blocks of this size
+
+/**
+ * Bump-pointer allocator. Memory is handed out from large blocks and never freed one piece at a time:
+ * all of it goes at once when the Arena is deleted.
+ * Any number of threads may allocate at once: they claim bytes of the current block with one atomic add,
+ * and only take blockLock when the block runs out.
+ */
+class Arena
+{
+private:
+    struct Block
+    {
+        char *data;
+        size_t size;
+        std::atomic<size_t> used;       //Bytes claimed, may pass size once the block is full
+        Block(char *_data, size_t _size, size_t _used) : data(_data), size(_size), used(_used) {}
+    };
+
+    std::atomic<Block *> current;   //Block allocations are carved from, nullptr before the first one
+    std::vector<Block *> blocks;
+    std::mutex blockLock;           //Guards blocks and replacing current
+    std::atomic<size_t> usage;      //Bytes of every block allocated so far
+
+    char *allocateFallback(Block *full, size_t bytes);
+
+    Block *allocateNewBlock(size_t bytes, size_t used);
+
+public:
+    Arena() : current(nullptr), usage(0) {}
+
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    char *allocateAligned(size_t bytes);
+
+    size_t memoryUsage(){return usage;}
+};
@@ -0,0 +1,114 @@
+#include "blockcache.h"
+
+/**
+ * @param _capacity Total bytes the cache may hold, split evenly over all shards.
+ * @param _shardBits The cache has 2 ^ _shardBits shards.
+ */
+BlockCache::BlockCache(uint64_t _capacity, int _shardBits)
+        : shardBits(_shardBits), capacity(_capacity), hits(0), misses(0)
+{
+    int shardNum = 1 << shardBits;
+    shards = new CacheShard[shardNum];
+    for (int i = 0; i < shardNum; ++i)
+        shards[i].capacity = (capacity + shardNum - 1) / shardNum;
+}
+
+BlockCache::~BlockCache()
+{
+    delete[] shards;
+}
+
+CacheShard &BlockCache::shardFor(const CacheKey &key)
+{
+    uint64_t h = CacheKeyHash()(key);
+    return shards[(h >> 32) & ((1 << shardBits) - 1)];
+}
+
+/**
+ * @brief Bytes an entry is charged against capacity (payload plus list/map bookkeeping).
+ */
+uint64_t BlockCache::charge(const std::string &val)
+{
+    return val.size() + 64;
+}
+
+/**
+ * @brief Look up a cached value and mark it as recently used.
+ * @return Handle to the value, nullptr on miss.
+ */
+CacheHandle BlockCache::lookup(uint64_t tableId, uint64_t offset)
+{
+    CacheKey key(tableId, offset);
+    CacheShard &shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.table.find(key);
+    if (it == shard.table.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->second;
+}
+
+/**
+ * @brief Insert a value, evicting least recently used entries of the same shard until it fits.
+ * @return Handle to the cached value.
+ */
+CacheHandle BlockCache::insert(uint64_t tableId, uint64_t offset, const std::string &val)
+{
+    CacheKey key(tableId, offset);
+    CacheHandle handle = std::make_shared<const std::string>(val);
+    CacheShard &shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    /* Replace the old entry if the key is already cached */
+    auto it = shard.table.find(key);
+    if (it != shard.table.end()) {
+        shard.usage -= charge(*it->second->second);
+        shard.lru.erase(it->second);
+        shard.table.erase(it);
+    }
+    /* Entries larger than the whole shard are handed back without being cached */
+    uint64_t c = charge(val);
+    if (c > shard.capacity) return handle;
+
+    while (shard.usage + c > shard.capacity && !shard.lru.empty()) {
+        CacheShard::Entry &victim = shard.lru.back();
+        shard.usage -= charge(*victim.second);
+        shard.table.erase(victim.first);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(CacheShard::Entry(key, handle));
+    shard.table[key] = shard.lru.begin();
+    shard.usage += c;
+    return handle;
+}
+
+/**
+ * @brief Drop every entry. Handles that are still held stay valid.
+ */
+void BlockCache::clear()
+{
+    int shardNum = 1 << shardBits;
+    for (int i = 0; i < shardNum; ++i) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].table.clear();
+        shards[i].lru.clear();
+        shards[i].usage = 0;
+    }
+}
+
+/**
+ * @return Bytes currently charged over all shards.
+ */
+uint64_t BlockCache::getUsage()
+{
+    uint64_t total = 0;
+    int shardNum = 1 << shardBits;
+    for (int i = 0; i < shardNum; ++i) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        total += shards[i].usage;
+    }
+    return total;
+}
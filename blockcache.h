@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define CACHE_CAPACITY (8 * 1024 * 1024)
+#define CACHE_SHARD_BITS 4
+
+/* Read-only handle to a cached value. The entry stays alive while a handle exists even if it is evicted. */
+typedef std::shared_ptr<const std::string> CacheHandle;
+
+struct CacheKey
+{
+    uint64_t tableId;
+    uint64_t offset;
+    CacheKey(uint64_t _id, uint64_t _offset) : tableId(_id), offset(_offset) {}
+    bool operator==(const CacheKey &other) const
+    {
+        return tableId == other.tableId && offset == other.offset;
+    }
+};
+
+struct CacheKeyHash
+{
+    size_t operator()(const CacheKey &k) const
+    {
+        uint64_t h = k.tableId * 0x9E3779B97F4A7C15ULL ^ k.offset;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return (size_t) h;
+    }
+};
+
+/**
+ * One LRU list guarded by its own mutex.
+ * The front of lru is the most recently used entry.
+ */
+struct CacheShard
+{
+    typedef std::pair<CacheKey, CacheHandle> Entry;
+    std::mutex lock;
+    std::list<Entry> lru;
+    std::unordered_map<CacheKey, std::list<Entry>::iterator, CacheKeyHash> table;
+    uint64_t usage = 0;
+    uint64_t capacity = 0;
+};
+
+/**
+ * Sharded, size-bounded LRU cache for SSTable reads, keyed by (SSTable id, offset).
+ * Eviction only locks the shard that is inserted into, so readers on other shards never wait for it.
+ */
+class BlockCache
+{
+private:
+    int shardBits;
+    CacheShard *shards;
+    uint64_t capacity;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    CacheShard &shardFor(const CacheKey &key);
+
+    static uint64_t charge(const std::string &val);
+
+public:
+    BlockCache(uint64_t _capacity = CACHE_CAPACITY, int _shardBits = CACHE_SHARD_BITS);
+
+    ~BlockCache();
+
+    CacheHandle lookup(uint64_t tableId, uint64_t offset);
+
+    CacheHandle insert(uint64_t tableId, uint64_t offset, const std::string &val);
+
+    void clear();
+
+    uint64_t getCapacity(){return capacity;}
+
+    uint64_t getUsage();
+
+    uint64_t getHits(){return hits.load();}
+
+    uint64_t getMisses(){return misses.load();}
+};
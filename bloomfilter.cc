@@ -2,51 +2,172 @@
 
 #include "bloomfilter.h"
 
-BloomFilter::BloomFilter()
+#ifdef BLOOM_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+/* Odd multipliers that pick the bit inside each of the 8 words of a line */
+static const uint32_t SALT[8] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/**
+ * @brief Split the key hash into the line index and the probe seed.
+ */
+static inline void hashKey(uint64_t key, uint32_t numLines, uint32_t &line, uint32_t &seed)
 {
-    data = new char[CAPACITY];
-    for (int i = 0; i < CAPACITY; ++i)
-        data[i] = '0';
+    uint64_t hash[2] = {0};
+    MurmurHash3_x64_128(&key, sizeof(uint64_t), 1, hash);
+    line = (uint32_t) (((hash[0] >> 32) * numLines) >> 32);
+    seed = (uint32_t) hash[1];
 }
 
-BloomFilter::BloomFilter(char *bf)
+/**
+ * @brief Whether every bit seed picks in line is set, one word at a time
+ */
+bool BloomFilter::probeScalar(const uint64_t *line, uint32_t seed)
 {
-    data = new char[CAPACITY];
-    for (int i = 0; i < CAPACITY; ++i)
-        data[i] = bf[i];
+    for (int i = 0; i < 8; ++i) {
+        uint64_t mask = 1ULL << ((seed * SALT[i]) >> 26);
+        if ((line[i] & mask) != mask) return false;
+    }
+    return true;
+}
+
+#ifdef BLOOM_HAVE_AVX2
+/**
+ * @brief Probe all 8 words of a line at once: build the 8 bit masks with one multiply
+ *        and two variable shifts, then test them against the line with two vptest.
+ */
+__attribute__((target("avx2")))
+bool BloomFilter::probeAVX2(const uint64_t *line, uint32_t seed)
+{
+    const __m256i salt = _mm256_loadu_si256((const __m256i *) SALT);
+    __m256i shift = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int) seed), salt), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i mask0 = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shift)));
+    __m256i mask1 = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shift, 1)));
+    __m256i word0 = _mm256_load_si256((const __m256i *) line);
+    __m256i word1 = _mm256_load_si256((const __m256i *) (line + 4));
+    return _mm256_testc_si256(word0, mask0) & _mm256_testc_si256(word1, mask1);
+}
+
+bool BloomFilter::hasAVX2()
+{
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+/**
+ * @brief Lines of a blocked filter for keyNum keys
+ */
+static uint32_t linesFor(uint64_t keyNum, int bitsPerKey)
+{
+    uint64_t bits = keyNum * (bitsPerKey > 0 ? bitsPerKey : 1);
+    uint32_t numLines = (uint32_t) ((bits + FILTER_LINE * 8 - 1) / (FILTER_LINE * 8));
+    return numLines ? numLines : 1;
+}
+
+/**
+ * @brief Create an empty blocked filter sized for keyNum keys.
+ * @param keyNum Number of keys that will be inserted.
+ * @param bitsPerKey Filter bits spent per key.
+ */
+BloomFilter::BloomFilter(uint64_t keyNum, int bitsPerKey)
+{
+    numLines = linesFor(keyNum, bitsPerKey);
+    raw = new char[(uint64_t) numLines * FILTER_LINE + FILTER_LINE];
+    data = raw + (FILTER_LINE - (uintptr_t) raw % FILTER_LINE) % FILTER_LINE;
+    memset(data, 0, (uint64_t) numLines * FILTER_LINE);
+}
+
+/**
+ * @brief Load a filter section read from an SSTable file (blocked or legacy).
+ * @param bf Start of the filter section.
+ */
+BloomFilter::BloomFilter(const char *bf)
+{
+    /* Legacy: CAPACITY ASCII bytes. Those were hashed through a type-punned buffer, and optimized
+     * builds wrote degenerate filters, so they are skipped and never probed. */
+    if (isLegacy(bf)) {
+        numLines = 0;
+        raw = data = nullptr;
+        return;
+    }
+    memcpy(&numLines, bf + 4, 4);
+    raw = new char[(uint64_t) numLines * FILTER_LINE + FILTER_LINE];
+    data = raw + (FILTER_LINE - (uintptr_t) raw % FILTER_LINE) % FILTER_LINE;
+    memcpy(data, bf + 8, (uint64_t) numLines * FILTER_LINE);
 }
 
 BloomFilter::~BloomFilter()
 {
-    delete data;
+    delete[] raw;
 }
 
 void BloomFilter::insert(uint64_t key)
 {
-    unsigned int hash[4] = {0};
-    MurmurHash3_x64_128(&key, sizeof(uint64_t), 1, hash);
-    for (int i = 0; i < 4; ++i)
-        data[hash[i] % CAPACITY] = '1';
+    /* Legacy filters are only loaded, never built */
+    if (numLines == 0) return;
+    uint32_t line, seed;
+    hashKey(key, numLines, line, seed);
+    uint64_t *words = (uint64_t *) (data + (uint64_t) line * FILTER_LINE);
+    for (int i = 0; i < 8; ++i)
+        words[i] |= 1ULL << ((seed * SALT[i]) >> 26);
+}
+
+/**
+ * @brief The line of key, and the seed its probes are picked with
+ */
+const uint64_t *BloomFilter::lineOf(uint64_t key, uint32_t &seed)
+{
+    uint32_t line;
+    hashKey(key, numLines, line, seed);
+    return (const uint64_t *) (data + (uint64_t) line * FILTER_LINE);
 }
 
 bool BloomFilter::isFind(uint64_t key)
 {
-    bool flag = true;
-    unsigned int hash[4] = {0};
-    MurmurHash3_x64_128(&key, sizeof(uint64_t), 1, hash);
-    for (int i = 0; i < 4; ++i) {
-        if (data[hash[i] % CAPACITY] == '0')
-            flag = false;
-    }
-    return flag;
+    /* Legacy filter: the dictionary decides */
+    if (numLines == 0) return true;
+    uint32_t seed;
+    const uint64_t *words = lineOf(key, seed);
+#ifdef BLOOM_HAVE_AVX2
+    if (hasAVX2()) return probeAVX2(words, seed);
+#endif
+    return probeScalar(words, seed);
+}
+
+/**
+ * @return Bytes the filter takes in an SSTable file.
+ */
+uint32_t BloomFilter::sectionSize()
+{
+    if (numLines == 0) return CAPACITY;
+    return 8 + numLines * FILTER_LINE;
+}
 
+/**
+ * @return Bytes the filter of keyNum keys will take in an SSTable file.
+ */
+uint32_t BloomFilter::sectionSize(uint64_t keyNum, int bitsPerKey)
+{
+    return 8 + linesFor(keyNum, bitsPerKey) * FILTER_LINE;
 }
 
-char *BloomFilter::returnData()
+/**
+ * @brief Write the filter section into buf (sectionSize() bytes).
+ */
+void BloomFilter::serialize(char *buf)
 {
-    char *retData = new char[CAPACITY + 1];
-    retData[CAPACITY] = '\0';
-    for (int i = 0; i < CAPACITY; ++i)
-        retData[i] = data[i];
-    return retData;
-}
\ No newline at end of file
+    if (numLines == 0) {
+        memset(buf, '1', CAPACITY);
+        return;
+    }
+    uint32_t magic = FILTER_MAGIC;
+    memcpy(buf, &magic, 4);
+    memcpy(buf + 4, &numLines, 4);
+    memcpy(buf + 8, data, (uint64_t) numLines * FILTER_LINE);
+}
@@ -5,20 +5,57 @@
 #pragma once
 #include "MurmurHash3.h"
 
-#define CAPACITY 10240
+#define CAPACITY 10240              //Size of the legacy filter section: one '0'/'1' byte per bit
+#define BITS_PER_KEY 10             //Default filter bits per key of the blocked filter
+/* Every key sets 8 bits, one per word of its line. That suits about 8 bits per key and more; with fewer,
+ * the line fills up and nearly every probe hits (5 bits per key: 17% false positives instead of 9%) */
+#define MIN_BITS_PER_KEY 8
+#define FILTER_MAGIC 0x32464C42     //"BLF2": first 4 bytes of a blocked filter section
+#define FILTER_LINE 64              //Bytes per filter line, all probes of a key hit one line
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOOM_HAVE_AVX2             //probeAVX2 is built, and used when the CPU has AVX2
+#endif
+
+/**
+ * Blocked Bloom filter: an array of 64-byte lines, each key sets one bit in each of
+ * the 8 64-bit words of a single line.
+ * On disk: [magic(4)][numLines(4)][numLines * 64 bytes].
+ * Files written before the blocked format (CAPACITY ASCII bytes of filter) still load; their filter
+ * answers "maybe" for every key.
+ */
 class BloomFilter
 {
 private:
+    char *raw;              //Allocation backing data (data is aligned to FILTER_LINE inside it), nullptr if legacy
     char *data;
+    uint32_t numLines;      //0: legacy filter
+
+    const uint64_t *lineOf(uint64_t key, uint32_t &seed);
+
+    static bool probeScalar(const uint64_t *line, uint32_t seed);
+
+#ifdef BLOOM_HAVE_AVX2
+    static bool probeAVX2(const uint64_t *line, uint32_t seed);
+
+    static bool hasAVX2();
+#endif
+
+    /* Tests check the probes against each other */
+    friend class FeatureTest;
 
 public:
-    BloomFilter();
-    BloomFilter(char *bf);
+    BloomFilter(uint64_t keyNum, int bitsPerKey = BITS_PER_KEY);
+    BloomFilter(const char *bf);
     ~BloomFilter();
     void insert(uint64_t key);
     bool isFind(uint64_t key);
-    char *returnData();
+    uint32_t sectionSize();
+    void serialize(char *buf);
+
+    static bool isLegacy(const char *bf){return bf[0] == '0' || bf[0] == '1';}
+
+    static uint32_t sectionSize(uint64_t keyNum, int bitsPerKey);
 
 };
 
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Little-endian fixed/varint encoding and CRC32 used by the MANIFEST and log records.
+ */
+namespace coding{
+    static inline void putFixed32(std::string &dst, uint32_t v){
+        char buf[4];
+        memcpy(buf, &v, 4);
+        dst.append(buf, 4);
+    }
+
+    static inline void putFixed64(std::string &dst, uint64_t v){
+        char buf[8];
+        memcpy(buf, &v, 8);
+        dst.append(buf, 8);
+    }
+
+    static inline uint32_t decodeFixed32(const char *p){
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static inline uint64_t decodeFixed64(const char *p){
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    static inline void putVarint64(std::string &dst, uint64_t v){
+        while (v >= 128) {
+            dst.push_back((char) (v | 128));
+            v >>= 7;
+        }
+        dst.push_back((char) v);
+    }
+
+    /**
+     * Decode a varint starting at p
+     * @param p read position, moved past the varint.
+     * @param limit end of the readable bytes.
+     * @param v decoded value.
+     * @return false if the varint is truncated or too long.
+     */
+    static inline bool getVarint64(const char *&p, const char *limit, uint64_t &v){
+        v = 0;
+        for (int shift = 0; shift <= 63 && p < limit; shift += 7) {
+            uint64_t byte = (unsigned char) *p++;
+            v |= (byte & 127) << shift;
+            if (byte < 128) return true;
+        }
+        return false;
+    }
+
+    struct CRCTable{
+        uint32_t t[256];
+        CRCTable(){
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+        }
+    };
+
+    /**
+     * CRC-32 (IEEE 802.3 polynomial)
+     * @param crc CRC of the preceding bytes, 0 to start.
+     */
+    static inline uint32_t crc32(const char *data, uint64_t len, uint32_t crc = 0){
+        static const CRCTable table;
+        crc = ~crc;
+        for (uint64_t i = 0; i < len; ++i)
+            crc = table.t[(crc ^ (unsigned char) data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+}
@@ -0,0 +1,260 @@
+#include <algorithm>
+
+#include "compactionpolicy.h"
+
+/**
+ * @brief The policy implementing options.compactionStyle, tuned by options
+ */
+CompactionPolicy *CompactionPolicy::create(const Options &options)
+{
+    switch (options.compactionStyle) {
+        case COMPACTION_LEVELED_DYNAMIC:
+            return new DynamicLeveledPolicy(options.l0CompactionTrigger, options.dynamicLevelMultiplier);
+        case COMPACTION_TIERED:
+            return new TieredPolicy();
+        case COMPACTION_UNIVERSAL:
+            return new UniversalPolicy();
+        default:
+            return new LeveledPolicy(options.l0CompactionTrigger, options.levelSizeMultiplier);
+    }
+}
+
+/**
+ * @return Bytes of the files of tables
+ */
+uint64_t CompactionPolicy::levelBytes(const std::vector<SSTable *> &tables)
+{
+    uint64_t bytes = 0;
+    for (SSTable *st : tables)
+        bytes += st->fileSize();
+    return bytes;
+}
+
+/**
+ * @brief Add the files of levels[level] overlapping the key range of the job's inputs to its inputs
+ */
+static void addOverlapping(const std::vector<std::vector<SSTable *>> &levels, int level, CompactionJob &job)
+{
+    if (level >= (int) levels.size()) return;
+    uint64_t minKey = UINT64_MAX;
+    uint64_t maxKey = 0;
+    for (std::pair<int, SSTable *> &input : job.inputs) {
+        SSInfo *header = input.second->returnHeader();
+        minKey = (minKey < header->minKey) ? minKey : header->minKey;
+        maxKey = (maxKey > header->maxKey) ? maxKey : header->maxKey;
+    }
+    for (SSTable *st : levels[level]) {
+        SSInfo *header = st->returnHeader();
+        if (!(header->maxKey < minKey || header->minKey > maxKey))
+            job.inputs.push_back(std::pair<int, SSTable *>(level, st));
+    }
+}
+
+/**
+ * @brief The oldest files of tables (same timeStamp: smaller minKey first)
+ */
+static std::vector<SSTable *> oldestFiles(const std::vector<SSTable *> &tables, uint64_t num)
+{
+    std::vector<SSTable *> files = tables;
+    std::stable_sort(files.begin(), files.end(), [](SSTable *a, SSTable *b) {
+        SSInfo *ha = a->returnHeader();
+        SSInfo *hb = b->returnHeader();
+        if (ha->timeStamp != hb->timeStamp) return ha->timeStamp < hb->timeStamp;
+        return ha->minKey < hb->minKey;
+    });
+    files.resize(num);
+    return files;
+}
+
+/**
+ * @brief Level0 may hold l0Trigger - 1 files, level i (i > 0) 2 * multiplier ^ i files. The first level above
+ *        that moves down: level0 as a whole, other levels their oldest files over the limit; with the files of
+ *        the next level they overlap. Deeper levels only grow by such moves, so a level0 compaction cascades down
+ *        the full levels.
+ */
+bool LeveledPolicy::pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job)
+{
+    uint64_t maxFilesNum = l0Trigger - 1;
+    for (int level = 0; level < (int) levels.size(); ++level) {
+        const std::vector<SSTable *> &tables = levels[level];
+        if (level == 1) maxFilesNum = 2 * multiplier;
+        else if (level > 1) maxFilesNum *= multiplier;
+        if (tables.size() <= maxFilesNum) continue;
+
+        job.inputs.clear();
+        std::vector<SSTable *> files = (level == 0) ? tables : oldestFiles(tables, tables.size() - maxFilesNum);
+        for (SSTable *st : files)
+            job.inputs.push_back(std::pair<int, SSTable *>(level, st));
+        job.outputLevel = level + 1;
+        addOverlapping(levels, level + 1, job);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Target sizes are derived from the last level: its own size, and multiplier times smaller each
+ *        level up, down to LEVEL_BASE_BYTES. The levels that would get less (above the base level) are kept
+ *        empty, and level0 goes straight to the base level. The level most over its target moves its oldest
+ *        file down; level0 scores its file count against l0Trigger.
+ */
+bool DynamicLeveledPolicy::pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job)
+{
+    const int lastLevel = NUM_LEVELS - 1;
+    uint64_t bytes[NUM_LEVELS];
+    for (int i = 0; i < NUM_LEVELS; ++i)
+        bytes[i] = (i < (int) levels.size()) ? levelBytes(levels[i]) : 0;
+
+    double target[NUM_LEVELS];
+    target[lastLevel] = std::max<double>(bytes[lastLevel], LEVEL_BASE_BYTES);
+    int baseLevel = lastLevel;
+    for (int i = lastLevel - 1; i >= 1; --i) {
+        target[i] = target[i + 1] / multiplier;
+        if (target[i] >= LEVEL_BASE_BYTES) baseLevel = i;
+    }
+    for (int i = 1; i < baseLevel; ++i)
+        target[i] = 0;
+
+    /* Score every level, the highest one at or above 1 is compacted */
+    int bestLevel = -1;
+    double bestScore = 1;
+    if (!levels.empty()) {
+        double score = (double) levels[0].size() / l0Trigger;
+        if (score >= bestScore) {
+            bestLevel = 0;
+            bestScore = score;
+        }
+    }
+    for (int i = 1; i < lastLevel && i < (int) levels.size(); ++i) {
+        if (bytes[i] == 0) continue;
+        double score = (target[i] == 0) ? 1e9 : bytes[i] / target[i];
+        if (score > bestScore) {
+            bestLevel = i;
+            bestScore = score;
+        }
+    }
+    if (bestLevel < 0) return false;
+
+    job.inputs.clear();
+    if (bestLevel == 0) {
+        for (SSTable *st : levels[0])
+            job.inputs.push_back(std::pair<int, SSTable *>(0, st));
+        /* Nothing may be jumped over: a non-empty level above the base level takes level0 instead */
+        job.outputLevel = baseLevel;
+        for (int i = 1; i < baseLevel && i < (int) levels.size(); ++i) {
+            if (!levels[i].empty()) {
+                job.outputLevel = i;
+                break;
+            }
+        }
+    }
+    else {
+        job.inputs.push_back(std::pair<int, SSTable *>(bestLevel, oldestFiles(levels[bestLevel], 1).front()));
+        job.outputLevel = bestLevel + 1;
+    }
+    addOverlapping(levels, job.outputLevel, job);
+    return true;
+}
+
+/**
+ * @brief List the sorted runs from the newest to the oldest: the level0 files, then every non-empty level
+ */
+void RunPolicy::listRuns(const std::vector<std::vector<SSTable *>> &levels, std::vector<Run> &runs)
+{
+    runs.clear();
+    for (int level = 0; level < (int) levels.size(); ++level) {
+        if (level == 0) {
+            for (SSTable *st : levels[0])
+                runs.push_back(Run{0, st, st->fileSize()});
+        }
+        else if (!levels[level].empty())
+            runs.push_back(Run{level, nullptr, levelBytes(levels[level])});
+    }
+}
+
+/**
+ * @brief Merge runs[first..last]. The result takes the level of the oldest run merged; if that is a level0 file,
+ *        it goes to the lowest empty level above the next older run (level0 if there is none), so levels keep
+ *        getting older downwards.
+ */
+void RunPolicy::makeJob(const std::vector<std::vector<SSTable *>> &levels, const std::vector<Run> &runs,
+                        uint64_t first, uint64_t last, CompactionJob &job)
+{
+    job.inputs.clear();
+    for (uint64_t i = first; i <= last; ++i) {
+        if (runs[i].table != nullptr)
+            job.inputs.push_back(std::pair<int, SSTable *>(0, runs[i].table));
+        else {
+            for (SSTable *st : levels[runs[i].level])
+                job.inputs.push_back(std::pair<int, SSTable *>(runs[i].level, st));
+        }
+    }
+    if (runs[last].level > 0) job.outputLevel = runs[last].level;
+    else if (last + 1 == runs.size()) job.outputLevel = NUM_LEVELS - 1;
+    else job.outputLevel = (runs[last + 1].level > 1) ? runs[last + 1].level - 1 : 0;
+}
+
+/**
+ * @brief Merge the newest TIER_MIN_RUNS or more neighbouring runs (at most TIER_MAX_RUNS) whose sizes all lie
+ *        within half and one and a half times the average of the group.
+ */
+bool TieredPolicy::pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job)
+{
+    std::vector<Run> runs;
+    listRuns(levels, runs);
+    for (uint64_t first = 0; first + TIER_MIN_RUNS <= runs.size(); ++first) {
+        uint64_t sum = runs[first].bytes;
+        uint64_t last = first;
+        while (last + 1 < runs.size() && last + 1 - first < TIER_MAX_RUNS) {
+            double avg = (double) sum / (last - first + 1);
+            uint64_t next = runs[last + 1].bytes;
+            if (next < avg * 0.5 || next > avg * 1.5) break;
+            sum += next;
+            ++last;
+        }
+        if (last - first + 1 >= TIER_MIN_RUNS) {
+            makeJob(levels, runs, first, last, job);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Once there are TIER_MIN_RUNS runs:
+ *        1. If the newer runs hold more than UNIVERSAL_MAX_SIZE_AMP % of the oldest, merge all of them.
+ *        2. Else merge the newest neighbouring runs, each at most UNIVERSAL_SIZE_RATIO % bigger than the sum
+ *           of the ones before it.
+ *        3. Else merge the newest runs, as many as it takes to get below TIER_MIN_RUNS.
+ */
+bool UniversalPolicy::pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job)
+{
+    std::vector<Run> runs;
+    listRuns(levels, runs);
+    uint64_t num = runs.size();
+    if (num < TIER_MIN_RUNS) return false;
+
+    uint64_t newer = 0;
+    for (uint64_t i = 0; i + 1 < num; ++i)
+        newer += runs[i].bytes;
+    if (newer * 100 > (uint64_t) UNIVERSAL_MAX_SIZE_AMP * runs[num - 1].bytes) {
+        makeJob(levels, runs, 0, num - 1, job);
+        return true;
+    }
+
+    for (uint64_t first = 0; first + 1 < num; ++first) {
+        uint64_t sum = runs[first].bytes;
+        uint64_t last = first;
+        while (last + 1 < num && runs[last + 1].bytes * 100 <= sum * (100 + UNIVERSAL_SIZE_RATIO)) {
+            sum += runs[last + 1].bytes;
+            ++last;
+        }
+        if (last > first) {
+            makeJob(levels, runs, first, last, job);
+            return true;
+        }
+    }
+
+    makeJob(levels, runs, 0, num - TIER_MIN_RUNS + 1, job);
+    return true;
+}
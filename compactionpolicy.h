@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "sstable.h"
+#include "options.h"
+
+#define NUM_LEVELS 7                    //Levels laid out up front by the policies that place data by size
+#define LEVEL_BASE_BYTES (8 * 1024 * 1024)      //Dynamic leveled: smallest target size of a level below level0
+#define TIER_MIN_RUNS 4                 //Tiered and universal: sorted runs before anything is merged
+#define TIER_MAX_RUNS 32                //Tiered: most runs merged at once
+#define UNIVERSAL_SIZE_RATIO 1          //Universal: a run joins the merge if it is at most this % bigger than the rest
+#define UNIVERSAL_MAX_SIZE_AMP 200      //Universal: merge everything once newer runs hold this % of the oldest one
+
+/**
+ * One compaction: the inputs merged and the level the result goes to.
+ * Inputs are listed from the newest to the oldest, which decides which version of a key wins.
+ * Output to level0 is written as a single file, as it is one sorted run there.
+ */
+struct CompactionJob
+{
+    std::vector<std::pair<int, SSTable *>> inputs;     //(level, SSTable)
+    int outputLevel;
+};
+
+/**
+ * Counters to compare compaction styles with. The byte and get counters cover the current process only: they are
+ * not saved and start at 0 on every open, so the amplifications are those of the work done since then.
+ * bytesTotal and bytesLastRun are the sizes of the store now.
+ */
+struct CompactionStats
+{
+    uint64_t bytesFlushed;          //SSTable bytes written by flushes
+    uint64_t bytesCompacted;        //SSTable bytes written by compactions
+    uint64_t bytesCompactionRead;   //SSTable bytes read by compactions
+    uint64_t gets;
+    uint64_t tablesProbed;          //SSTables whose key range those gets searched
+    uint64_t readErrors;            //Keys read as not found because the block holding them could not be read
+    uint64_t bytesTotal;            //Bytes of every SSTable now
+    uint64_t bytesLastRun;          //Bytes of the oldest sorted run now
+    double writeAmplification;      //(bytesFlushed + bytesCompacted) / bytesFlushed, 0 if nothing was flushed yet
+    double readAmplification;       //tablesProbed / gets, 0 if there were no gets
+    double spaceAmplification;      //bytesTotal / bytesLastRun, 0 if there are no SSTables
+};
+
+/**
+ * Decides what to compact. Level0 holds overlapping files sorted from newest to oldest,
+ * every other level one sorted run of non-overlapping files.
+ */
+class CompactionPolicy
+{
+public:
+    virtual ~CompactionPolicy() {}
+
+    /**
+     * @brief Choose the next compaction.
+     * @return false if nothing needs compacting
+     */
+    virtual bool pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job) = 0;
+
+    static CompactionPolicy *create(const Options &options);
+
+    static uint64_t levelBytes(const std::vector<SSTable *> &tables);
+};
+
+class LeveledPolicy : public CompactionPolicy
+{
+private:
+    uint64_t l0Trigger;             //Options::l0CompactionTrigger
+    uint64_t multiplier;            //Options::levelSizeMultiplier
+
+public:
+    LeveledPolicy(uint64_t _l0Trigger, uint64_t _multiplier) : l0Trigger(_l0Trigger), multiplier(_multiplier) {}
+
+    bool pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job) override;
+};
+
+class DynamicLeveledPolicy : public CompactionPolicy
+{
+private:
+    uint64_t l0Trigger;             //Options::l0CompactionTrigger
+    uint64_t multiplier;            //Options::dynamicLevelMultiplier
+
+public:
+    DynamicLeveledPolicy(uint64_t _l0Trigger, uint64_t _multiplier) : l0Trigger(_l0Trigger), multiplier(_multiplier) {}
+
+    bool pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job) override;
+};
+
+/**
+ * Base of the policies that merge whole sorted runs: every level0 file is a run, and so is every non-empty level.
+ * Only runs next to each other in age are merged, so the newest version of a key keeps winning.
+ */
+class RunPolicy : public CompactionPolicy
+{
+protected:
+    struct Run
+    {
+        int level;
+        SSTable *table;             //The level0 file, nullptr for a whole level
+        uint64_t bytes;
+    };
+
+    void listRuns(const std::vector<std::vector<SSTable *>> &levels, std::vector<Run> &runs);
+
+    void makeJob(const std::vector<std::vector<SSTable *>> &levels, const std::vector<Run> &runs,
+                 uint64_t first, uint64_t last, CompactionJob &job);
+};
+
+class TieredPolicy : public RunPolicy
+{
+public:
+    bool pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job) override;
+};
+
+class UniversalPolicy : public RunPolicy
+{
+public:
+    bool pick(const std::vector<std::vector<SSTable *>> &levels, CompactionJob &job) override;
+};
@@ -0,0 +1,149 @@
+#include <cstring>
+
+#include "compression.h"
+#include "coding.h"
+
+namespace compression{
+    static inline uint32_t read32(const char *p){
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static inline uint32_t hash32(uint32_t v){
+        return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+    }
+
+    /**
+     * Append a length field's extension bytes: len is what did not fit in its 4 bits of the token
+     */
+    static inline void putLength(std::string &dst, uint64_t len){
+        while (len >= 255) {
+            dst.push_back((char) 255);
+            len -= 255;
+        }
+        dst.push_back((char) len);
+    }
+
+    /**
+     * Read a length field of the token (nibble) plus its extension bytes
+     * @return false if the input ends inside the extension
+     */
+    static inline bool getLength(const unsigned char *&p, const unsigned char *limit, uint64_t nibble,
+                                 uint64_t &len){
+        len = nibble;
+        if (nibble < 15) return true;
+        while (p < limit) {
+            unsigned char b = *p++;
+            len += b;
+            if (b < 255) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Append one sequence: literals [lit, lit + litLen), then a match of matchLen bytes offset back
+     * (matchLen 0: last sequence, literals only)
+     */
+    static void putSequence(std::string &dst, const char *lit, uint64_t litLen, uint64_t offset, uint64_t matchLen){
+        uint64_t litNibble = litLen < 15 ? litLen : 15;
+        uint64_t matchNibble = 0;
+        if (matchLen > 0) matchNibble = matchLen - LZ_MIN_MATCH < 15 ? matchLen - LZ_MIN_MATCH : 15;
+        dst.push_back((char) (litNibble << 4 | matchNibble));
+        if (litNibble == 15) putLength(dst, litLen - 15);
+        dst.append(lit, litLen);
+        if (matchLen == 0) return;
+        dst.push_back((char) (offset & 255));
+        dst.push_back((char) (offset >> 8));
+        if (matchNibble == 15) putLength(dst, matchLen - LZ_MIN_MATCH - 15);
+    }
+
+    /**
+     * @brief Compress len bytes at src, appending the result to dst. Greedy: every position is looked up in a
+     *        hash table of the last position each 4-byte sequence was seen at, and the first match found is taken.
+     */
+    void lzCompress(const char *src, uint64_t len, std::string &dst){
+        coding::putVarint64(dst, len);
+        uint32_t table[1 << LZ_HASH_BITS];
+        memset(table, 0xFF, sizeof(table));
+        uint64_t anchor = 0;                //Start of the literals not written yet
+        uint64_t pos = 0;
+        uint64_t matchLimit = len > LZ_LAST_LITERALS ? len - LZ_LAST_LITERALS : 0;
+        while (pos + LZ_MIN_MATCH <= matchLimit) {
+            uint32_t seq = read32(src + pos);
+            uint32_t h = hash32(seq);
+            uint64_t ref = table[h];
+            table[h] = (uint32_t) pos;
+            if (ref == UINT32_MAX || pos - ref > LZ_MAX_OFFSET || read32(src + ref) != seq) {
+                ++pos;
+                continue;
+            }
+            uint64_t matchLen = LZ_MIN_MATCH;
+            while (pos + matchLen < matchLimit && src[ref + matchLen] == src[pos + matchLen])
+                ++matchLen;
+            putSequence(dst, src + anchor, pos - anchor, pos - ref, matchLen);
+            pos += matchLen;
+            anchor = pos;
+        }
+        putSequence(dst, src + anchor, len - anchor, 0, 0);
+    }
+
+    /**
+     * @brief Decompress len bytes at src into dst (replacing its content)
+     * @return false if the input is corrupt
+     */
+    bool lzDecompress(const char *src, uint64_t len, std::string &dst){
+        const char *head = src;
+        uint64_t rawLen;
+        if (!coding::getVarint64(head, src + len, rawLen)) return false;
+        /* A byte of input never stands for more than 255 bytes of output */
+        if (rawLen > len * 255) return false;
+        dst.resize(rawLen);
+        char *out = &dst[0];
+        uint64_t outPos = 0;
+        const unsigned char *p = (const unsigned char *) head;
+        const unsigned char *limit = (const unsigned char *) src + len;
+        while (p < limit) {
+            unsigned char token = *p++;
+            uint64_t litLen, matchLen;
+            if (!getLength(p, limit, token >> 4, litLen)) return false;
+            if (litLen > (uint64_t) (limit - p) || litLen > rawLen - outPos) return false;
+            memcpy(out + outPos, p, litLen);
+            p += litLen;
+            outPos += litLen;
+            /* The last sequence ends the input */
+            if (p == limit) break;
+            if (limit - p < 2) return false;
+            uint64_t offset = p[0] | (uint64_t) p[1] << 8;
+            p += 2;
+            if (!getLength(p, limit, token & 15, matchLen)) return false;
+            matchLen += LZ_MIN_MATCH;
+            if (offset == 0 || offset > outPos || matchLen > rawLen - outPos) return false;
+            /* A match closer than its length repeats the bytes it produces: copy those byte by byte */
+            const char *from = out + outPos - offset;
+            if (offset >= matchLen) memcpy(out + outPos, from, matchLen);
+            else {
+                for (uint64_t i = 0; i < matchLen; ++i)
+                    out[outPos + i] = from[i];
+            }
+            outPos += matchLen;
+        }
+        return outPos == rawLen;
+    }
+
+    /**
+     * @brief Decode a block stored with codec type into dst
+     * @return false if the codec is unknown or the block corrupt
+     */
+    bool uncompress(CompressionType type, const char *src, uint64_t len, std::string &dst){
+        switch (type) {
+            case COMPRESSION_NONE:
+                dst.assign(src, len);
+                return true;
+            case COMPRESSION_LZ:
+                return lzDecompress(src, len, dst);
+            default:
+                return false;
+        }
+    }
+}
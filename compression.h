@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#define LZ_HASH_BITS 10             //Entries of the match finder's hash table: 2 ^ LZ_HASH_BITS, enough for a block
+#define LZ_MIN_MATCH 4              //Shortest match worth a sequence
+#define LZ_MAX_OFFSET 65535         //Matches are at most this far back (2-byte offsets)
+#define LZ_LAST_LITERALS 5          //The last bytes of the input are always literals
+
+/**
+ * Codec of one SSTable data block, stored with the block so a file can mix them
+ * @param COMPRESSION_NONE raw bytes
+ * @param COMPRESSION_LZ the in-tree LZ77 codec below
+ */
+enum CompressionType
+{
+    COMPRESSION_NONE = 0,
+    COMPRESSION_LZ = 1
+};
+
+/**
+ * Byte-oriented LZ77 codec in the style of LZ4, with no dependency outside the tree.
+ * Compressed form: varint(raw length), then sequences of
+ * [token][literal length extension][literals][offset(2)][match length extension]: the high 4 bits of token
+ * are the literal length, the low 4 bits the match length - LZ_MIN_MATCH, 15 in either meaning 255-valued
+ * extension bytes follow (the last one below 255). The last sequence has literals only and ends the input.
+ */
+namespace compression{
+    void lzCompress(const char *src, uint64_t len, std::string &dst);
+
+    bool lzDecompress(const char *src, uint64_t len, std::string &dst);
+
+    bool uncompress(CompressionType type, const char *src, uint64_t len, std::string &dst);
+}
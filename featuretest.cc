@@ -0,0 +1,1357 @@
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "test.h"
+#include "compression.h"
+#include "memtable.h"
+#include "manifest.h"
+#include "utils.h"
+#include "wal.h"
+
+class FeatureTest : public Test {
+private:
+	const uint64_t TEST_MAX = 1024 * 64;
+	const uint64_t BATCH_NUM = 64;
+	const uint64_t BATCH_SIZE = 100;
+	const uint64_t WRITER_NUM = 3;
+	const uint64_t INSERT_ROUNDS = 3000;
+	const uint64_t WAL_RECORDS = 300;
+	const uint64_t CONCURRENT_KEYS = 4000;
+	const uint64_t VISIBLE_ROUNDS = 2000;
+
+	std::map<uint64_t, std::string> ref;
+
+	static std::string value(uint64_t i, char c)
+	{
+		return std::string(i % 200 + 1, c) + std::to_string(i);
+	}
+
+	/* Keys 0, 2, 4, ... with every fifth one deleted again, spread over SSTables and MemTable */
+	void prepare(uint64_t max)
+	{
+		uint64_t i;
+		store.reset();
+		ref.clear();
+		for (i = 0; i < max; ++i) {
+			store.put(2 * i, value(i, 's'));
+			ref[2 * i] = value(i, 's');
+		}
+		for (i = 0; i < max; i += 5) {
+			EXPECT(true, store.del(2 * i));
+			ref.erase(2 * i);
+		}
+	}
+
+	void iterator_test(uint64_t max)
+	{
+		uint64_t i;
+		Iterator *it = store.newIterator();
+
+		// Forward and backward over everything
+		auto rp = ref.begin();
+		for (it->seekToFirst(); it->valid(); it->next(), ++rp) {
+			if (rp == ref.end()) break;
+			EXPECT(rp->first, it->key());
+			EXPECT(rp->second, it->value());
+		}
+		EXPECT(true, rp == ref.end() && !it->valid());
+		auto rr = ref.rbegin();
+		for (it->seekToLast(); it->valid(); it->prev(), ++rr) {
+			if (rr == ref.rend()) break;
+			EXPECT(rr->first, it->key());
+		}
+		EXPECT(true, rr == ref.rend() && !it->valid());
+		phase();
+
+		// seek and seekForPrev land on the nearest live key, odd keys are never present
+		for (i = 0; i < 2 * max + 2; i += 7) {
+			auto lb = ref.lower_bound(i);
+			it->seek(i);
+			EXPECT(lb != ref.end(), it->valid());
+			if (lb != ref.end() && it->valid()) EXPECT(lb->first, it->key());
+
+			auto ub = ref.upper_bound(i);
+			it->seekForPrev(i);
+			EXPECT(ub != ref.begin(), it->valid());
+			if (ub != ref.begin() && it->valid()) EXPECT(std::prev(ub)->first, it->key());
+		}
+		phase();
+
+		// Change direction in the middle
+		it->seek(max);
+		auto mp = ref.lower_bound(max);
+		for (i = 0; i < 50 && it->valid(); ++i) {
+			it->next();
+			++mp;
+		}
+		for (i = 0; i < 80 && it->valid(); ++i) {
+			it->prev();
+			--mp;
+		}
+		EXPECT(true, it->valid());
+		if (it->valid()) {
+			EXPECT(mp->first, it->key());
+			EXPECT(mp->second, it->value());
+		}
+		phase();
+		delete it;
+	}
+
+	void multiget_test(uint64_t max)
+	{
+		uint64_t i;
+		std::vector<uint64_t> keys;
+		for (i = 0; i < 4 * max; i += 3)
+			keys.push_back((i * 7919) % (2 * max + 10));
+		std::vector<std::string> values;
+		CompactionStats before, after;
+		store.getStats(before);
+		store.multiGet(keys, values);
+		store.getStats(after);
+		EXPECT(keys.size(), values.size());
+		EXPECT(before.gets + keys.size(), after.gets);
+		EXPECT(true, after.tablesProbed > before.tablesProbed);
+		for (i = 0; i < keys.size() && i < values.size(); ++i)
+			EXPECT(values[i], store.get(keys[i]));
+		phase();
+	}
+
+	/* A child writes batches and dies without closing the store; every batch must come back whole */
+	void batch_recovery_test()
+	{
+		uint64_t i, j;
+		const std::string dir = "./featuredata_batch";
+		{
+			KVStore clean(dir);
+			clean.reset();
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			KVStore *child = new KVStore(dir);
+			for (i = 0; i < BATCH_NUM; ++i) {
+				WriteBatch batch;
+				for (j = 0; j < BATCH_SIZE; ++j)
+					batch.put(i * BATCH_SIZE + j, value(i * BATCH_SIZE + j, 'b'));
+				if (i > 0)
+					batch.del((i - 1) * BATCH_SIZE);
+				if (!child->write(batch)) _exit(1);
+			}
+			_exit(0);
+		}
+		int status = -1;
+		waitpid(pid, &status, 0);
+		EXPECT(0, status);
+
+		KVStore recovered(dir);
+		for (i = 0; i < BATCH_NUM; ++i) {
+			for (j = 0; j < BATCH_SIZE; ++j) {
+				uint64_t key = i * BATCH_SIZE + j;
+				bool isDeleted = j == 0 && i + 1 < BATCH_NUM;
+				EXPECT(isDeleted ? not_found : value(key, 'b'), recovered.get(key));
+			}
+		}
+		recovered.reset();
+		phase();
+	}
+
+	/* The blocked filter finds every key put in, rarely one that was not, and answers the same with both probes */
+	void bloom_filter_test()
+	{
+		uint64_t i;
+		const uint64_t keys = 20000;
+		const uint64_t others = 200000;
+		// Bits per key, and the false positive rate they must stay under (measured: 2.9%, 1.0%, 0.02%)
+		std::vector<std::pair<int, double>> limits = {{MIN_BITS_PER_KEY, 0.04}, {BITS_PER_KEY, 0.015}, {20, 0.0005}};
+		for (const std::pair<int, double> &limit : limits) {
+			BloomFilter bf(keys, limit.first);
+			for (i = 0; i < keys; ++i)
+				bf.insert(i * 7919);
+			uint64_t missed = 0;
+			for (i = 0; i < keys; ++i)
+				missed += bf.isFind(i * 7919) ? 0 : 1;
+			uint64_t positives = 0;
+			for (i = 0; i < others; ++i)
+				positives += bf.isFind(i * 7919 + 1) ? 1 : 0;
+			EXPECT(0, missed);
+			EXPECT(true, positives < others * limit.second);
+
+			// Whichever one isFind uses, the scalar and AVX2 probes answer alike for members and others
+			uint64_t disagree = 0;
+			for (i = 0; i < 2 * keys; ++i) {
+				uint32_t seed;
+				const uint64_t *line = bf.lineOf(i * 7919 + i % 2, seed);
+				bool found = BloomFilter::probeScalar(line, seed);
+				if (found != bf.isFind(i * 7919 + i % 2)) ++disagree;
+#ifdef BLOOM_HAVE_AVX2
+				if (BloomFilter::hasAVX2() && found != BloomFilter::probeAVX2(line, seed)) ++disagree;
+#endif
+			}
+			EXPECT(0, disagree);
+
+			// A filter read back from its section answers the same
+			std::string section(bf.sectionSize(), '\0');
+			bf.serialize(&section[0]);
+			BloomFilter loaded(section.data());
+			uint64_t differ = 0;
+			for (i = 0; i < 2 * keys; ++i)
+				differ += (loaded.isFind(i * 7919 + i % 2) != bf.isFind(i * 7919 + i % 2)) ? 1 : 0;
+			EXPECT(0, differ);
+		}
+
+		// A legacy section ('0'/'1' bytes) is not probed: every key may be there
+		std::string legacy(CAPACITY, '0');
+		BloomFilter old(legacy.data());
+		EXPECT((uint32_t) CAPACITY, old.sectionSize());
+		for (i = 0; i < keys; ++i)
+			EXPECT(true, old.isFind(i));
+		phase();
+	}
+
+	void options_test()
+	{
+		const std::string dir = "./featuredata_options";
+		Options options;
+		options.memTableBytes = 256 * 1024;
+		options.bitsPerKey = 12;
+		options.blockSize = 1024;
+		options.compactionStyle = COMPACTION_TIERED;
+		options.compression = {COMPRESSION_LZ};
+		options.useMmap = true;
+
+		// encode/decode and save/load give back the same options
+		std::remove((dir + "/" + OPTIONS_NAME).c_str());
+		Options decoded;
+		EXPECT(true, decoded.decode(options.encode()));
+		EXPECT(options.encode(), decoded.encode());
+		{
+			KVStore saved(dir, options);
+			saved.reset();
+			saved.put(1, "options");
+			std::vector<std::string> warnings;
+			saved.getOptionWarnings(warnings);
+			EXPECT((size_t) 0, warnings.size());
+		}
+		Options loaded;
+		EXPECT(true, loaded.load(dir));
+		EXPECT(options.encode(), loaded.encode());
+
+		// Out of range values are clamped and reported
+		Options bad = options;
+		bad.blockSize = 1;
+		std::vector<std::string> fixes;
+		EXPECT(false, bad.sanitize(&fixes));
+		EXPECT((size_t) 1, fixes.size());
+		EXPECT((uint64_t) 256, bad.blockSize);
+		bad.bitsPerKey = 1;
+		EXPECT(false, bad.sanitize());
+		EXPECT(MIN_BITS_PER_KEY, bad.bitsPerKey);
+
+		// A corrupt OPTIONS file is reported and left alone, the data is still there
+		{
+			std::ofstream out(dir + "/" + OPTIONS_NAME);
+			out << "not an option\n";
+		}
+		{
+			KVStore reopened(dir);
+			std::vector<std::string> warnings;
+			reopened.getOptionWarnings(warnings);
+			EXPECT((size_t) 1, warnings.size());
+			EXPECT(std::string("options"), reopened.get(1));
+		}
+		std::string text;
+		std::ifstream in(dir + "/" + OPTIONS_NAME);
+		std::getline(in, text);
+		EXPECT(std::string("not an option"), text);
+		phase();
+	}
+
+	void compression_test()
+	{
+		uint64_t i;
+		std::vector<std::string> inputs;
+		inputs.push_back("");
+		inputs.push_back("a");
+		inputs.push_back(std::string(100000, 'z'));
+		std::string text;
+		for (i = 0; i < 5000; ++i)
+			text += "key" + std::to_string(i % 97) + "=" + value(i, 'v').substr(0, 20) + ";";
+		inputs.push_back(text);
+		std::string noise;
+		uint64_t x = 88172645463325252ULL;
+		for (i = 0; i < 70000; ++i) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			noise.push_back((char) x);
+		}
+		inputs.push_back(noise);
+
+		for (const std::string &in : inputs) {
+			std::string packed, unpacked;
+			compression::lzCompress(in.data(), in.size(), packed);
+			EXPECT(true, compression::lzDecompress(packed.data(), packed.size(), unpacked));
+			EXPECT(in.size(), unpacked.size());
+			EXPECT(true, in == unpacked);
+			if (in.size() > 1) {
+				std::string cut;
+				EXPECT(false, compression::lzDecompress(packed.data(), packed.size() / 2, cut));
+			}
+		}
+		phase();
+	}
+
+	/* Writers race on the same keys of a fresh MemTable; the list must stay sorted with one node per key */
+	void memtable_insert_test()
+	{
+		uint64_t round, i;
+		const uint64_t keyNum = 256;
+		uint64_t unordered = 0;
+		uint64_t wrongSize = 0;
+		for (round = 0; round < INSERT_ROUNDS; ++round) {
+			MemTable *table = new MemTable();
+			std::atomic<uint64_t> ready(0);
+			std::vector<std::thread> writers;
+			for (i = 0; i < WRITER_NUM; ++i) {
+				writers.emplace_back([this, table, i, round, keyNum, &ready]() {
+					/* Start together, every writer walking the keys in its own order */
+					++ready;
+					while (ready < WRITER_NUM)
+						std::this_thread::yield();
+					for (uint64_t j = 0; j < keyNum; ++j)
+						table->put((j * (2 * i + 1) + round) % keyNum, std::to_string(i), j + 1);
+				});
+			}
+			for (std::thread &writer : writers)
+				writer.join();
+
+			MemTableIterator it(table);
+			uint64_t num = 0;
+			uint64_t last = 0;
+			for (it.seekToFirst(); it.valid(); it.next(), ++num) {
+				if (num > 0 && it.key() <= last) ++unordered;
+				last = it.key();
+			}
+			if (num != keyNum) ++wrongSize;
+			table->unref();
+		}
+		EXPECT((uint64_t) 0, unordered);
+		EXPECT((uint64_t) 0, wrongSize);
+		phase();
+	}
+
+	/* Descriptors this process has open */
+	static uint64_t countOpenFiles()
+	{
+		std::vector<std::string> names;
+		return utils::scanDir("/proc/self/fd", names);
+	}
+
+	/* Deeper levels are read one SSTable at a time: walking the store keeps a bounded number of files open */
+	void iterator_files_test()
+	{
+		uint64_t i;
+		const uint64_t max = 40000;
+		const std::string dir = "./featuredata_files";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		KVStore small(dir, options);
+		small.reset();
+		for (i = 0; i < max; ++i)
+			small.put(i, value(i, 'f'));
+		uint64_t tables = countTables(dir);
+		EXPECT(true, tables > 50);
+
+		uint64_t before = countOpenFiles();
+		uint64_t most = 0;
+		Iterator *it = small.newIterator();
+		for (it->seekToFirst(), i = 0; it->valid(); it->next(), ++i) {
+			EXPECT(i, it->key());
+			if (i % 1000 == 0) most = std::max(most, countOpenFiles() - before);
+		}
+		EXPECT(max, i);
+		for (it->seekToLast(); it->valid(); it->prev())
+			most = std::max(most, countOpenFiles() - before);
+		delete it;
+		EXPECT(true, most < 16);
+		small.reset();
+		phase();
+	}
+
+	/* Files of every level of the store in dir */
+	static uint64_t countTables(const std::string &dir)
+	{
+		uint64_t num = 0;
+		for (int level = 0; utils::dirExists(dir + "/Level" + std::to_string(level)); ++level) {
+			std::vector<std::string> names;
+			num += utils::scanDir(dir + "/Level" + std::to_string(level), names);
+		}
+		return num;
+	}
+
+	static void writeManifest(const std::string &dir, const std::string &content)
+	{
+		std::ofstream out(dir + "/" + MANIFEST_NAME, std::ios::binary | std::ios::trunc);
+		out.write(content.data(), content.size());
+	}
+
+	/* A damaged MANIFEST must not cost any data: the store refuses to open and leaves every file alone */
+	void manifest_test()
+	{
+		uint64_t i;
+		const uint64_t max = 20000;
+		const std::string dir = "./featuredata_manifest";
+		{
+			KVStore writer(dir);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'm'));
+		}
+		std::string content;
+		EXPECT(0, utils::readFile((dir + "/" + MANIFEST_NAME).c_str(), content));
+		uint64_t tables = countTables(dir);
+		EXPECT(true, tables > 0);
+
+		// One flipped byte in the first record
+		std::string damaged = content;
+		damaged[10] ^= 0x40;
+		writeManifest(dir, damaged);
+		{
+			KVStore reopened(dir);
+			EXPECT(false, reopened.isOpened());
+			EXPECT(not_found, reopened.get(1));
+			EXPECT(false, reopened.tryPut(1, "lost"));
+		}
+		EXPECT(tables, countTables(dir));
+		std::string kept;
+		utils::readFile((dir + "/" + MANIFEST_NAME).c_str(), kept);
+		EXPECT(true, kept == damaged);
+
+		// A record cut short at the tail is an append a crash interrupted
+		writeManifest(dir, content + std::string("\x01\x02\x03\x04\x40", 5));
+		{
+			KVStore reopened(dir);
+			EXPECT(true, reopened.isOpened());
+			for (i = 0; i < max; ++i)
+				EXPECT(value(i, 'm'), reopened.get(i));
+			reopened.reset();
+		}
+		phase();
+	}
+
+	/* Damage the first data block of every SSTable below level0, return their file names */
+	static void damageBlocks(const std::string &dir, std::vector<std::string> &damaged)
+	{
+		for (int level = 1; utils::dirExists(dir + "/Level" + std::to_string(level)); ++level) {
+			std::vector<std::string> names;
+			utils::scanDir(dir + "/Level" + std::to_string(level), names);
+			for (const std::string &name : names) {
+				std::string path = dir + "/Level" + std::to_string(level) + "/" + name;
+				std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+				file.seekp(32, std::ios::beg);
+				file.write(std::string(16, '\xff').data(), 16);
+				damaged.push_back(name);
+			}
+		}
+	}
+
+	/* Whether an SSTable named name is in some level: a trivial move links it into the next one */
+	static bool hasTable(const std::string &dir, const std::string &name)
+	{
+		for (int level = 0; utils::dirExists(dir + "/Level" + std::to_string(level)); ++level) {
+			if (utils::fileExists(dir + "/Level" + std::to_string(level) + "/" + name)) return true;
+		}
+		return false;
+	}
+
+	/* A block that cannot be read stops the compaction it is an input of: no input is deleted */
+	void corrupt_block_test()
+	{
+		uint64_t i;
+		const uint64_t max = 20000;
+		const std::string dir = "./featuredata_corrupt";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		{
+			KVStore writer(dir, options);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'c'));
+		}
+		std::vector<std::string> damaged;
+		damageBlocks(dir, damaged);
+		EXPECT(true, !damaged.empty());
+
+		// Rewrites over the whole range: level0 is merged with the damaged SSTables
+		{
+			KVStore reopened(dir, options);
+			for (i = 0; i < max; i += 2)
+				reopened.put(i, value(i, 'd'));
+			for (i = 0; i < max; i += 2)
+				EXPECT(value(i, 'd'), reopened.get(i));
+		}
+		for (const std::string &name : damaged)
+			EXPECT(true, hasTable(dir, name));
+		KVStore(dir, options).reset();
+		phase();
+	}
+
+	/* Path of the newest SSTable of level0 */
+	static std::string newestTable(const std::string &dir)
+	{
+		std::vector<std::string> names;
+		uint64_t newest = 0;
+		utils::scanDir(dir + "/Level0", names);
+		for (const std::string &name : names)
+			newest = std::max(newest, (uint64_t) std::stoull(name.substr(7)));
+		return dir + "/Level0/" + SSTable::fileName(newest);
+	}
+
+	/* Damage the first data block of the newest SSTable of level0 */
+	static void damageNewest(const std::string &dir)
+	{
+		std::fstream file(newestTable(dir), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(32, std::ios::beg);
+		file.write(std::string(16, '\xff').data(), 16);
+	}
+
+	/* Damage the index of the newest SSTable of level0, return its path */
+	static std::string damageIndex(const std::string &dir)
+	{
+		std::string path = newestTable(dir);
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		uint64_t indexOffset = 0;
+		file.seekg(utils::fileSize(path) - 24, std::ios::beg);
+		file.read((char *) &indexOffset, 8);
+		file.seekp(indexOffset, std::ios::beg);
+		file.write(std::string(16, '\xff').data(), 16);
+		return path;
+	}
+
+	/* A block that cannot be read hides the key: an older SSTable must not answer in its place */
+	void read_error_test()
+	{
+		uint64_t i;
+		const uint64_t max = 5000;
+		const std::string dir = "./featuredata_read";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		options.l0CompactionTrigger = 1000;
+		{
+			KVStore writer(dir, options);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'o'));
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'n'));
+		}
+		damageNewest(dir);
+
+		KVStore reopened(dir, options);
+		std::vector<uint64_t> keys;
+		uint64_t lost = 0;
+		for (i = 0; i < max; ++i) {
+			std::string got = reopened.get(i);
+			EXPECT(true, got != value(i, 'o'));
+			if (got == "") ++lost;
+			keys.push_back(i);
+		}
+		CompactionStats stats;
+		reopened.getStats(stats);
+		EXPECT(true, lost > 0);
+		EXPECT(lost, stats.readErrors);
+
+		std::vector<std::string> values;
+		reopened.multiGet(keys, values);
+		for (i = 0; i < max; ++i)
+			EXPECT(true, values[i] != value(i, 'o'));
+		reopened.getStats(stats);
+		EXPECT(2 * lost, stats.readErrors);
+		reopened.reset();
+		phase();
+	}
+
+	/* An SSTable whose index cannot be read answers for none of its keys, and no compaction consumes it */
+	void index_error_test()
+	{
+		uint64_t i;
+		const uint64_t max = 5000;
+		const std::string dir = "./featuredata_index";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		options.l0CompactionTrigger = 1000;
+		{
+			KVStore writer(dir, options);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'o'));
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'n'));
+		}
+		std::string damaged = damageIndex(dir);
+
+		for (bool useMmap : {false, true}) {
+			options.useMmap = useMmap;
+			KVStore reopened(dir, options);
+			std::vector<uint64_t> keys;
+			uint64_t lost = 0;
+			for (i = 0; i < max; ++i) {
+				std::string got = reopened.get(i);
+				EXPECT(true, got != value(i, 'o'));
+				if (got == "") ++lost;
+				keys.push_back(i);
+			}
+			CompactionStats stats;
+			reopened.getStats(stats);
+			EXPECT(true, lost > 0);
+			EXPECT(lost, stats.readErrors);
+			std::vector<std::string> values;
+			reopened.multiGet(keys, values);
+			for (i = 0; i < max; ++i)
+				EXPECT(true, values[i] != value(i, 'o'));
+		}
+
+		// Level0 is compacted on reopening: the damaged SSTable must stay
+		options = Options();
+		options.memTableBytes = 64 * 1024;
+		{
+			KVStore reopened(dir, options);
+			for (i = 0; i < max; i += 2)
+				reopened.put(i, value(i, 'd'));
+			for (i = 0; i < max; i += 2)
+				EXPECT(value(i, 'd'), reopened.get(i));
+		}
+		EXPECT(true, utils::fileExists(damaged));
+		KVStore(dir, options).reset();
+		phase();
+	}
+
+	/* A flush that fails during recovery leaves replayed pairs in MemTable: later writes to them must still win */
+	void replay_sequence_test()
+	{
+		uint64_t i;
+		const uint64_t max = 1000;
+		const std::string dir = "./featuredata_sequence";
+		{
+			KVStore clean(dir);
+			clean.reset();
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			Options big;
+			big.memTableBytes = 4 * 1024 * 1024;
+			KVStore *child = new KVStore(dir, big);
+			for (i = 0; i < max; ++i)
+				child->put(i, value(i, 'o'));
+			_exit(0);
+		}
+		int status = -1;
+		waitpid(pid, &status, 0);
+		EXPECT(0, status);
+
+		// level0 can not be written: the replay overflows one MemTable, its flush fails, the rest stays in mem
+		utils::rmdir((dir + "/Level0").c_str());
+		std::ofstream((dir + "/Level0").c_str()).put('x');
+		Options small;
+		small.memTableBytes = 64 * 1024;
+		{
+			KVStore reopened(dir, small);
+			reopened.put(max - 1, "new");
+			EXPECT("new", reopened.get(max - 1));
+			std::remove((dir + "/Level0").c_str());
+		}
+		KVStore recovered(dir, small);
+		EXPECT("new", recovered.get(max - 1));
+		for (i = 0; i + 1 < max; ++i)
+			EXPECT(value(i, 'o'), recovered.get(i));
+		recovered.reset();
+		phase();
+	}
+
+	/* Writers share one log in group commit: every record is written once, in the order of its sequence */
+	void wal_group_test()
+	{
+		uint64_t i, w;
+		const std::string dir = "./featuredata_wal";
+		const std::string path = dir + "/" + WAL::fileName(1);
+		utils::mkdir(dir.c_str());
+		std::remove(path.c_str());
+		std::vector<std::vector<uint64_t>> sequences(WRITER_NUM);
+		{
+			WAL wal(path, SYNC_GROUP, 0);
+			std::vector<std::thread> writers;
+			for (w = 0; w < WRITER_NUM; ++w) {
+				writers.emplace_back([this, &wal, &sequences, w]() {
+					for (uint64_t r = 0; r < WAL_RECORDS; ++r) {
+						std::string payload;
+						WAL::encodePut(payload, w * WAL_RECORDS + r, value(r, 'w'));
+						uint64_t sequence = 0;
+						if (wal.addRecord(payload, sequence)) sequences[w].push_back(sequence);
+					}
+				});
+			}
+			for (std::thread &t : writers)
+				t.join();
+			EXPECT(WRITER_NUM * WAL_RECORDS, wal.getLastSequence());
+		}
+
+		// Sequence s is the s-th record of the file
+		std::vector<std::pair<uint64_t, std::string>> ops;
+		EXPECT(true, WAL::replay(path, ops));
+		EXPECT(WRITER_NUM * WAL_RECORDS, ops.size());
+		for (w = 0; w < WRITER_NUM; ++w) {
+			EXPECT(WAL_RECORDS, sequences[w].size());
+			for (i = 0; i < sequences[w].size(); ++i) {
+				uint64_t s = sequences[w][i];
+				EXPECT(true, s > 0 && s <= ops.size());
+				if (s == 0 || s > ops.size()) continue;
+				EXPECT(w * WAL_RECORDS + i, ops[s - 1].first);
+				EXPECT(value(i, 'w'), ops[s - 1].second);
+			}
+		}
+		std::remove(path.c_str());
+		utils::rmdir(dir.c_str());
+		phase();
+	}
+
+	/* In every sync mode, a child that dies without closing the store loses none of its acknowledged writes */
+	void wal_recovery_test()
+	{
+		uint64_t w, r;
+		const std::string dir = "./featuredata_sync";
+		WALSyncMode modes[] = {SYNC_NONE, SYNC_PER_WRITE, SYNC_GROUP};
+		for (WALSyncMode mode : modes) {
+			Options options;
+			options.syncMode = mode;
+			{
+				KVStore clean(dir, options);
+				clean.reset();
+			}
+			pid_t pid = fork();
+			if (pid == 0) {
+				KVStore *child = new KVStore(dir, options);
+				std::vector<std::thread> writers;
+				for (w = 0; w < WRITER_NUM; ++w) {
+					writers.emplace_back([this, child, w]() {
+						for (uint64_t i = 0; i < WAL_RECORDS; ++i) {
+							if (!child->tryPut(w * WAL_RECORDS + i, value(i, 's'))) _exit(1);
+						}
+					});
+				}
+				for (std::thread &t : writers)
+					t.join();
+				_exit(0);
+			}
+			int status = -1;
+			waitpid(pid, &status, 0);
+			EXPECT(0, status);
+
+			KVStore recovered(dir, options);
+			for (w = 0; w < WRITER_NUM; ++w) {
+				for (r = 0; r < WAL_RECORDS; ++r)
+					EXPECT(value(r, 's'), recovered.get(w * WAL_RECORDS + r));
+			}
+			recovered.reset();
+		}
+		phase();
+	}
+
+	/* Writers and readers share a store while it flushes and compacts: a get returns nothing or the value written */
+	void concurrent_test()
+	{
+		uint64_t i, w;
+		const std::string dir = "./featuredata_concurrent";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		KVStore shared(dir, options);
+		shared.reset();
+		std::atomic<uint64_t> done(0);
+		std::atomic<uint64_t> wrong(0);
+		std::atomic<uint64_t> failed(0);
+		std::vector<std::thread> threads;
+		for (w = 0; w < WRITER_NUM; ++w) {
+			threads.emplace_back([this, &shared, &done, &failed, w]() {
+				for (uint64_t n = 0; n < CONCURRENT_KEYS; ++n) {
+					uint64_t key = n * WRITER_NUM + w;
+					if (!shared.tryPut(key, value(key, 'c'))) ++failed;
+				}
+				++done;
+			});
+		}
+		for (w = 0; w < 2; ++w) {
+			threads.emplace_back([this, &shared, &done, &wrong, w]() {
+				uint64_t key = w;
+				while (done < WRITER_NUM) {
+					key = (key * 7919 + 13) % (CONCURRENT_KEYS * WRITER_NUM);
+					std::string got = shared.get(key);
+					if (got != "" && got != value(key, 'c')) ++wrong;
+				}
+			});
+		}
+		for (std::thread &t : threads)
+			t.join();
+		EXPECT(0, failed.load());
+		EXPECT(0, wrong.load());
+		for (i = 0; i < CONCURRENT_KEYS * WRITER_NUM; ++i)
+			EXPECT(value(i, 'c'), shared.get(i));
+		EXPECT(true, countTables(dir) > 0);
+		shared.reset();
+		phase();
+	}
+
+	/* Readers running alongside write see each batch whole: every key of a multiGet, scan or iterator holds the same round */
+	void batch_visibility_test()
+	{
+		uint64_t j;
+		const std::string dir = "./featuredata_visibility";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		KVStore shared(dir, options);
+		shared.reset();
+		std::vector<uint64_t> keys;
+		for (j = 0; j < BATCH_SIZE; ++j)
+			keys.push_back(j);
+		std::atomic<bool> done(false);
+		std::atomic<uint64_t> torn(0);
+		std::atomic<uint64_t> failed(0);
+		std::vector<std::thread> threads;
+		threads.emplace_back([this, &shared, &done, &failed]() {
+			for (uint64_t i = 0; i < VISIBLE_ROUNDS; ++i) {
+				WriteBatch batch;
+				for (uint64_t k = 0; k < BATCH_SIZE; ++k)
+					batch.put(k, value(i, 'v'));
+				if (!shared.write(batch)) ++failed;
+			}
+			done = true;
+		});
+		threads.emplace_back([&shared, &keys, &done, &torn]() {
+			std::vector<std::string> vals;
+			while (!done) {
+				shared.multiGet(keys, vals);
+				if (std::count(vals.begin(), vals.end(), vals[0]) != (long) vals.size()) ++torn;
+			}
+		});
+		threads.emplace_back([this, &shared, &done, &torn]() {
+			std::list<std::pair<uint64_t, std::string>> list;
+			while (!done) {
+				shared.scan(0, BATCH_SIZE, list);
+				for (const std::pair<uint64_t, std::string> &kv : list) {
+					if (list.size() != BATCH_SIZE || kv.second != list.front().second) ++torn;
+				}
+				list.clear();
+				Iterator *it = shared.newIterator();
+				uint64_t n = 0;
+				std::string first;
+				for (it->seekToFirst(); it->valid(); it->next(), ++n) {
+					if (n == 0) first = it->value();
+					else if (it->value() != first) ++torn;
+				}
+				if (n != 0 && n != BATCH_SIZE) ++torn;
+				delete it;
+			}
+		});
+		for (std::thread &t : threads)
+			t.join();
+		EXPECT(0, failed.load());
+		EXPECT(0, torn.load());
+		for (j = 0; j < BATCH_SIZE; ++j)
+			EXPECT(value(VISIBLE_ROUNDS - 1, 'v'), shared.get(j));
+		shared.reset();
+		phase();
+	}
+
+	/* An iterator reads the Version it was opened on: compactions that replace its SSTables meanwhile change nothing */
+	void snapshot_test()
+	{
+		uint64_t i;
+		const uint64_t max = 10000;
+		const std::string dir = "./featuredata_snapshot";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		{
+			KVStore writer(dir, options);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i, value(i, 'o'));
+		}
+		KVStore reopened(dir, options);
+		uint64_t tables = countTables(dir);
+		Iterator *it = reopened.newIterator();
+		for (i = 0; i < max; ++i)
+			reopened.put(i, value(i, 'n'));
+		EXPECT(true, countTables(dir) > tables);
+
+		// The MemTable of the Version may hold some new values, the SSTables hold the old ones
+		uint64_t old = 0;
+		for (it->seekToFirst(), i = 0; it->valid() && i < max; it->next(), ++i) {
+			EXPECT(i, it->key());
+			if (it->value() == value(i, 'o')) ++old;
+			else EXPECT(value(i, 'n'), it->value());
+		}
+		EXPECT(max, i);
+		EXPECT(true, old > 0);
+		EXPECT(false, it->hasError());
+		delete it;
+		for (i = 0; i < max; ++i)
+			EXPECT(value(i, 'n'), reopened.get(i));
+		reopened.reset();
+		phase();
+	}
+
+	/* The SSTables of one level of the store in dir, sorted by minKey; unref them when done */
+	static void openLevel(const std::string &dir, int level, std::vector<SSTable *> &tables)
+	{
+		std::vector<std::string> names;
+		utils::scanDir(dir + "/Level" + std::to_string(level), names);
+		for (const std::string &name : names)
+			tables.push_back(new SSTable(dir + "/Level" + std::to_string(level) + "/" + name));
+		std::sort(tables.begin(), tables.end(), [](SSTable *a, SSTable *b) {
+			return a->returnHeader()->minKey < b->returnHeader()->minKey;
+		});
+	}
+
+	/* Each compaction style keeps every value through overwrites and deletes, and lays the levels out as it promises */
+	void compaction_style_test()
+	{
+		uint64_t i, round;
+		const uint64_t max = 20000;
+		for (CompactionStyle style : {COMPACTION_LEVELED, COMPACTION_LEVELED_DYNAMIC, COMPACTION_TIERED, COMPACTION_UNIVERSAL}) {
+			const std::string dir = "./featuredata_style" + std::to_string(style);
+			Options options;
+			options.memTableBytes = 64 * 1024;
+			options.compactionStyle = style;
+			std::map<uint64_t, std::string> expected;
+			{
+				KVStore store(dir, options);
+				store.reset();
+				for (round = 0; round < 3; ++round) {
+					for (i = 0; i < max; ++i) {
+						store.put(i, value(i + round, (char) ('a' + round)));
+						expected[i] = value(i + round, (char) ('a' + round));
+					}
+					for (i = round; i < max; i += 7) {
+						store.del(i);
+						expected.erase(i);
+					}
+				}
+				for (i = 0; i < max; ++i)
+					EXPECT(expected.count(i) ? expected[i] : not_found, store.get(i));
+				std::list<std::pair<uint64_t, std::string>> list;
+				store.scan(0, max, list);
+				std::list<std::pair<uint64_t, std::string>> want(expected.begin(), expected.end());
+				EXPECT(want.size(), list.size());
+				EXPECT(true, want == list);
+
+				CompactionStats stats;
+				store.getStats(stats);
+				EXPECT(true, stats.bytesCompacted > 0);
+				EXPECT(true, stats.writeAmplification >= 1);
+				EXPECT(true, stats.readAmplification > 0);
+				EXPECT(true, stats.spaceAmplification >= 1 && stats.spaceAmplification < 10);
+			}
+
+			// Closing runs the compactions left: the levels are as the policy leaves them
+			std::vector<std::vector<SSTable *>> levels(NUM_LEVELS);
+			for (int level = 0; level < NUM_LEVELS; ++level) {
+				if (utils::dirExists(dir + "/Level" + std::to_string(level))) openLevel(dir, level, levels[level]);
+			}
+			uint64_t runs = levels[0].size();
+			for (int level = 1; level < NUM_LEVELS; ++level)
+				runs += levels[level].empty() ? 0 : 1;
+			if (style == COMPACTION_LEVELED) {
+				EXPECT(true, levels[0].size() < options.l0CompactionTrigger);
+				for (int level = 1; level < NUM_LEVELS; ++level) {
+					uint64_t limit = 2 * options.levelSizeMultiplier;
+					for (int l = 1; l < level; ++l) limit *= options.levelSizeMultiplier;
+					EXPECT(true, levels[level].size() <= limit);
+				}
+			}
+			// Far less data than LEVEL_BASE_BYTES: the last level is the base level, the ones above it stay empty
+			if (style == COMPACTION_LEVELED_DYNAMIC) {
+				for (int level = 1; level < NUM_LEVELS - 1; ++level)
+					EXPECT((size_t) 0, levels[level].size());
+				EXPECT(true, !levels[NUM_LEVELS - 1].empty());
+			}
+			// A merge of the oldest run goes to the last level, every level holds runs older than those above it
+			if (style == COMPACTION_TIERED || style == COMPACTION_UNIVERSAL) {
+				EXPECT(true, !levels[NUM_LEVELS - 1].empty());
+				uint64_t newer = UINT64_MAX;
+				for (int level = 0; level < NUM_LEVELS; ++level) {
+					uint64_t newest = 0;
+					uint64_t oldest = UINT64_MAX;
+					for (SSTable *st : levels[level]) {
+						newest = std::max(newest, st->returnHeader()->timeStamp);
+						oldest = std::min(oldest, st->returnHeader()->timeStamp);
+					}
+					if (levels[level].empty()) continue;
+					EXPECT(true, newest <= newer);
+					newer = oldest;
+				}
+			}
+			if (style == COMPACTION_UNIVERSAL)
+				EXPECT(true, runs < TIER_MIN_RUNS);
+			for (std::vector<SSTable *> &tables : levels) {
+				for (SSTable *st : tables)
+					st->unref();
+			}
+			KVStore(dir, options).reset();
+		}
+		phase();
+	}
+
+	/* Big compactions are cut into key ranges merged side by side; the levels they write must stay sorted runs */
+	void subcompaction_test()
+	{
+		uint64_t i;
+		const uint64_t max = 20011;
+		const std::string dir = "./featuredata_split";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		options.compression = {COMPRESSION_NONE};
+		{
+			KVStore writer(dir, options);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i * 7919 % max, value(i * 7919 % max, 'p'));
+		}
+
+		// Below level0, no two SSTables of a level overlap
+		std::vector<SSTable *> all;
+		for (int level = 1; utils::dirExists(dir + "/Level" + std::to_string(level)); ++level) {
+			std::vector<SSTable *> tables;
+			openLevel(dir, level, tables);
+			for (uint64_t t = 1; t < tables.size(); ++t)
+				EXPECT(true, tables[t - 1]->returnHeader()->maxKey < tables[t]->returnHeader()->minKey);
+			all.insert(all.end(), tables.begin(), tables.end());
+		}
+		EXPECT(true, !all.empty());
+
+		// All of them merged at once would be cut into MAX_SUBCOMPACTIONS parts
+		KVStore reopened(dir, options);
+		std::vector<uint64_t> bounds;
+		reopened.splitCompaction(all, bounds);
+		EXPECT(MAX_SUBCOMPACTIONS - 1, bounds.size());
+		for (i = 0; i < bounds.size(); ++i) {
+			EXPECT(true, bounds[i] > 0 && bounds[i] < max);
+			if (i > 0) EXPECT(true, bounds[i - 1] < bounds[i]);
+		}
+		for (SSTable *st : all)
+			st->unref();
+
+		for (i = 0; i < max; ++i)
+			EXPECT(value(i, 'p'), reopened.get(i));
+		reopened.reset();
+		phase();
+	}
+
+	/* Ascending keys never overlap what is already stored: compactions move the SSTables down without rewriting them */
+	void trivial_move_test()
+	{
+		uint64_t i;
+		const uint64_t max = 20000;
+		const std::string dir = "./featuredata_move";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		KVStore moving(dir, options);
+		moving.reset();
+		for (i = 0; i < max; ++i)
+			moving.put(i, value(i, 'v'));
+		CompactionStats stats;
+		moving.getStats(stats);
+		std::vector<std::string> level0;
+		utils::scanDir(dir + "/Level0", level0);
+		EXPECT(true, countTables(dir) > level0.size());
+		EXPECT(true, stats.bytesFlushed > 0);
+		EXPECT(0, stats.bytesCompacted);
+		EXPECT(0, stats.bytesCompactionRead);
+		for (i = 0; i < max; ++i)
+			EXPECT(value(i, 'v'), moving.get(i));
+		moving.reset();
+		phase();
+	}
+
+	/* Outputs of a compaction are cut once they span MAX_GRANDPARENT_OVERLAP_FILES SSTables worth of the level below */
+	void grandparent_test()
+	{
+		uint64_t i, t;
+		const uint64_t gpNum = 40;
+		const std::string dir = "./featuredata_grandparent";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		options.compression = {COMPRESSION_NONE};
+		KVStore combining(dir, options);
+		combining.reset();
+		utils::mkdir((dir + "/Level1").c_str());
+		utils::mkdir((dir + "/Level2").c_str());
+
+		// Grandparents of about memTableBytes each, side by side
+		std::vector<SSTable *> grandparents;
+		uint64_t gpMax = 0;
+		for (t = 0; t < gpNum; ++t) {
+			MemTable *table = new MemTable();
+			for (i = 0; i < 500; ++i)
+				table->put(t * 1000 + 2 * i, std::string(120, 'g'), 1);
+			grandparents.push_back(table->createSSTable(1, dir + "/Level2/" + SSTable::fileName(1000 + t)));
+			table->unref();
+			gpMax = std::max(gpMax, grandparents.back()->fileSize());
+		}
+
+		// A small input spanning all of them
+		MemTable *input = new MemTable();
+		for (i = 0; i < gpNum * 1000; i += 4)
+			input->put(i, value(i, 'i'), 1);
+		for (int withGrandparents = 0; withGrandparents < 2; ++withGrandparents) {
+			std::vector<SSTable *> outputs;
+			std::vector<SSTable *> none;
+			Iterator *it = new MemTableIterator(input);
+			EXPECT(true, combining.kwayCombine(it, 0, UINT64_MAX, 1, 1, false, false, UINT64_MAX,
+			                                   withGrandparents ? grandparents : none, outputs));
+			delete it;
+			EXPECT(true, withGrandparents ? outputs.size() > 1 : outputs.size() == 1);
+			uint64_t pairs = 0;
+			for (SSTable *st : outputs) {
+				SSInfo *h = st->returnHeader();
+				pairs += h->size;
+				uint64_t overlap = 0;
+				for (SSTable *gp : grandparents) {
+					SSInfo *g = gp->returnHeader();
+					if (!(g->maxKey < h->minKey || g->minKey > h->maxKey)) overlap += gp->fileSize();
+				}
+				if (withGrandparents)
+					EXPECT(true, overlap <= MAX_GRANDPARENT_OVERLAP_FILES * options.memTableBytes + 2 * gpMax);
+				st->markObsolete();
+				st->unref();
+			}
+			EXPECT(gpNum * 250, pairs);
+		}
+		input->unref();
+		for (SSTable *gp : grandparents) {
+			gp->markObsolete();
+			gp->unref();
+		}
+		combining.reset();
+		phase();
+	}
+
+	/* The cache keeps the most recently used blocks within its capacity; a handle outlives the eviction of its entry */
+	void block_cache_test()
+	{
+		uint64_t i, w;
+		const uint64_t entry = 1000;
+		BlockCache lru(10 * (entry + 64), 0);
+		for (i = 0; i < 10; ++i)
+			lru.insert(1, i * entry, std::string(entry, 'a' + i));
+		EXPECT(10 * (entry + 64), lru.getUsage());
+		CacheHandle kept = lru.lookup(1, 2 * entry);
+		EXPECT(true, kept != nullptr);
+		EXPECT(true, lru.lookup(1, 0) != nullptr);
+
+		// The least recently used entry makes room: offset entry, as 0 and 2 * entry were just read
+		lru.insert(2, 0, std::string(entry, 'z'));
+		EXPECT(true, lru.lookup(1, entry) == nullptr);
+		EXPECT(true, lru.lookup(1, 0) != nullptr);
+		EXPECT(true, lru.lookup(2, 0) != nullptr);
+		EXPECT(4, lru.getHits());
+		EXPECT(1, lru.getMisses());
+
+		// Too big for the cache: handed back, not cached
+		CacheHandle big = lru.insert(3, 0, std::string(20 * entry, 'b'));
+		EXPECT(20 * entry, big->size());
+		EXPECT(true, lru.lookup(3, 0) == nullptr);
+
+		lru.clear();
+		EXPECT(0, lru.getUsage());
+		EXPECT(std::string(entry, 'c'), *kept);
+
+		// Shards under concurrent use: every hit holds the value of its key, usage stays within capacity
+		const uint64_t capacity = 256 * 1024;
+		BlockCache shared(capacity);
+		std::atomic<uint64_t> wrong(0);
+		std::vector<std::thread> threads;
+		for (w = 0; w < WRITER_NUM; ++w) {
+			threads.emplace_back([&shared, &wrong, w]() {
+				uint64_t x = w + 1;
+				for (uint64_t n = 0; n < 20000; ++n) {
+					x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+					uint64_t key = (x >> 33) % 2000;
+					CacheHandle h = shared.lookup(key % 7, key);
+					if (h == nullptr) shared.insert(key % 7, key, std::string(key % 500 + 1, 'k') + std::to_string(key));
+					else if (*h != std::string(key % 500 + 1, 'k') + std::to_string(key)) ++wrong;
+				}
+			});
+		}
+		for (std::thread &t : threads)
+			t.join();
+		EXPECT(0, wrong.load());
+		EXPECT(true, shared.getHits() > 0);
+		EXPECT(true, shared.getUsage() <= capacity + (1 << CACHE_SHARD_BITS));
+		phase();
+	}
+
+	/* Bytes this process has read from files so far */
+	static uint64_t bytesRead()
+	{
+		std::ifstream io("/proc/self/io");
+		std::string name;
+		uint64_t bytes = 0;
+		while (io >> name >> bytes) {
+			if (name == "rchar:") return bytes;
+		}
+		return 0;
+	}
+
+	/* Opening a store reads its MANIFEST, not its SSTables: filters and indexes are loaded by the first reads */
+	void lazy_open_test()
+	{
+		uint64_t i, w;
+		const uint64_t max = 20000;
+		const std::string dir = "./featuredata_lazy";
+		Options options;
+		options.memTableBytes = 64 * 1024;
+		options.bitsPerKey = 20;
+		options.compression = {COMPRESSION_NONE};
+		{
+			KVStore writer(dir, options);
+			writer.reset();
+			for (i = 0; i < max; ++i)
+				writer.put(i * 7919 % max, value(i * 7919 % max, 'l'));
+		}
+		uint64_t tables = countTables(dir);
+		EXPECT(true, tables > 10);
+
+		// A filter alone takes bitsPerKey / 8 bytes per key, hundreds of bytes per SSTable
+		uint64_t before = bytesRead();
+		KVStore reopened(dir, options);
+		EXPECT(true, bytesRead() - before < tables * 256);
+
+		// The first reads of every SSTable race to load it
+		std::atomic<uint64_t> wrong(0);
+		std::vector<std::thread> readers;
+		for (w = 0; w < WRITER_NUM; ++w) {
+			readers.emplace_back([this, &reopened, &wrong, w]() {
+				for (uint64_t key = w; key < max; key += WRITER_NUM) {
+					if (reopened.get(key) != value(key, 'l')) ++wrong;
+				}
+			});
+		}
+		for (std::thread &t : readers)
+			t.join();
+		EXPECT(0, wrong.load());
+		reopened.reset();
+		phase();
+	}
+
+public:
+	FeatureTest(const std::string &dir, bool v=true) : Test(dir, v)
+	{
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		std::cout << "KVStore Feature Test" << std::endl;
+
+		prepare(TEST_MAX);
+		phase();
+
+		std::cout << "[Iterator Test]" << std::endl;
+		iterator_test(TEST_MAX);
+
+		std::cout << "[Iterator Files Test]" << std::endl;
+		iterator_files_test();
+
+		std::cout << "[MultiGet Test]" << std::endl;
+		multiget_test(TEST_MAX);
+
+		std::cout << "[Batch Recovery Test]" << std::endl;
+		batch_recovery_test();
+
+		std::cout << "[Bloom Filter Test]" << std::endl;
+		bloom_filter_test();
+
+		std::cout << "[Options Test]" << std::endl;
+		options_test();
+
+		std::cout << "[Compression Test]" << std::endl;
+		compression_test();
+
+		std::cout << "[MemTable Insert Test]" << std::endl;
+		memtable_insert_test();
+
+		std::cout << "[Manifest Test]" << std::endl;
+		manifest_test();
+
+		std::cout << "[Corrupt Block Test]" << std::endl;
+		corrupt_block_test();
+
+		std::cout << "[Read Error Test]" << std::endl;
+		read_error_test();
+
+		std::cout << "[Index Error Test]" << std::endl;
+		index_error_test();
+
+		std::cout << "[Replay Sequence Test]" << std::endl;
+		replay_sequence_test();
+
+		std::cout << "[WAL Group Commit Test]" << std::endl;
+		wal_group_test();
+
+		std::cout << "[WAL Recovery Test]" << std::endl;
+		wal_recovery_test();
+
+		std::cout << "[Concurrent Test]" << std::endl;
+		concurrent_test();
+
+		std::cout << "[Batch Visibility Test]" << std::endl;
+		batch_visibility_test();
+
+		std::cout << "[Snapshot Test]" << std::endl;
+		snapshot_test();
+
+		std::cout << "[Compaction Style Test]" << std::endl;
+		compaction_style_test();
+
+		std::cout << "[Subcompaction Test]" << std::endl;
+		subcompaction_test();
+
+		std::cout << "[Trivial Move Test]" << std::endl;
+		trivial_move_test();
+
+		std::cout << "[Grandparent Test]" << std::endl;
+		grandparent_test();
+
+		std::cout << "[Block Cache Test]" << std::endl;
+		block_cache_test();
+
+		std::cout << "[Lazy Open Test]" << std::endl;
+		lazy_open_test();
+
+		store.reset();
+		report();
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	FeatureTest test("./featuredata", verbose);
+
+	test.start_test();
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Cursor over K-V pairs in ascending key order. Deletions show up as the value "~DELETE~".
+ * A fresh iterator must be positioned with one of the seek functions before use.
+ */
+class Iterator
+{
+public:
+    virtual ~Iterator() {}
+
+    virtual bool valid() = 0;
+
+    virtual void seekToFirst() = 0;
+
+    virtual void seekToLast() = 0;
+
+    /* Move to the first K-V pair whose key >= key */
+    virtual void seek(uint64_t key) = 0;
+
+    /* Move to the last K-V pair whose key <= key */
+    virtual void seekForPrev(uint64_t key) = 0;
+
+    virtual void next() = 0;
+
+    virtual void prev() = 0;
+
+    virtual uint64_t key() = 0;
+
+    virtual const std::string &value() = 0;
+
+    /* true once a read or a decode failed: K-V pairs may have been skipped since */
+    virtual bool hasError(){return false;}
+};
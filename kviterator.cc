@@ -0,0 +1,81 @@
+#include "kviterator.h"
+#include "sstableiterator.h"
+#include "leveliterator.h"
+
+/**
+ * @param _version what to iterate over, already ref'ed for this iterator
+ * @param sequence the MemTables of _version are read as of this write
+ */
+KVIterator::KVIterator(Version *_version, uint64_t sequence) : version(_version)
+{
+    /* Sources from the newest to the oldest. Level0 files overlap, each needs its own cursor;
+     * a deeper level is read one file at a time */
+    std::vector<Iterator *> children;
+    children.push_back(new MemTableIterator(version->mem, sequence));
+    if (version->imm != nullptr)
+        children.push_back(new MemTableIterator(version->imm, sequence));
+    for (uint64_t level = 0; level < version->levels.size(); ++level) {
+        std::vector<SSTable *> &tables = version->levels[level];
+        if (level > 0) {
+            if (!tables.empty()) children.push_back(new LevelIterator(tables));
+            continue;
+        }
+        for (SSTable *st : tables)
+            children.push_back(new SSTableIterator(st));
+    }
+    iter = new MergingIterator(children);
+}
+
+KVIterator::~KVIterator()
+{
+    delete iter;
+    version->unref();
+}
+
+void KVIterator::skipDeletedForward()
+{
+    while (iter->valid() && iter->value() == "~DELETE~")
+        iter->next();
+}
+
+void KVIterator::skipDeletedBackward()
+{
+    while (iter->valid() && iter->value() == "~DELETE~")
+        iter->prev();
+}
+
+void KVIterator::seekToFirst()
+{
+    iter->seekToFirst();
+    skipDeletedForward();
+}
+
+void KVIterator::seekToLast()
+{
+    iter->seekToLast();
+    skipDeletedBackward();
+}
+
+void KVIterator::seek(uint64_t key)
+{
+    iter->seek(key);
+    skipDeletedForward();
+}
+
+void KVIterator::seekForPrev(uint64_t key)
+{
+    iter->seekForPrev(key);
+    skipDeletedBackward();
+}
+
+void KVIterator::next()
+{
+    iter->next();
+    skipDeletedForward();
+}
+
+void KVIterator::prev()
+{
+    iter->prev();
+    skipDeletedBackward();
+}
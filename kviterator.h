@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "mergingiterator.h"
+#include "version.h"
+
+/**
+ * Iterator handed out by KVStore::newIterator(): the merged view of MemTable, imm and every SSTable,
+ * without deleted keys. It holds the Version it was built from, so flushes and compactions can go on
+ * while it is open; the files they replace are deleted when the iterator is.
+ * It reads the MemTables as of the last write visible when it was created: later writes are not seen.
+ * It must be deleted before the KVStore.
+ */
+class KVIterator : public Iterator
+{
+private:
+    MergingIterator *iter;
+    Version *version;
+
+    void skipDeletedForward();
+
+    void skipDeletedBackward();
+
+public:
+    KVIterator(Version *_version, uint64_t sequence);
+
+    ~KVIterator();
+
+    bool valid() override {return iter->valid();}
+
+    void seekToFirst() override;
+
+    void seekToLast() override;
+
+    void seek(uint64_t key) override;
+
+    void seekForPrev(uint64_t key) override;
+
+    void next() override;
+
+    void prev() override;
+
+    uint64_t key() override {return iter->key();}
+
+    const std::string &value() override {return iter->value();}
+
+    bool hasError() override {return iter->hasError();}
+};
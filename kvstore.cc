@@ -3,58 +3,548 @@
 #include <string>
 #include "utils.h"
 #include <fstream>
+#include <algorithm>
+#include "sstablebuilder.h"
 
-KVStore::KVStore(const std::string &dir): KVStoreAPI(dir)
+/**
+ * @brief Open the store in dir with options; values out of range are clamped (see Options::sanitize).
+ *        Every SSTable records its own filter, block size and codecs, so a store may be reopened with other options,
+ *        but for its compaction style. What had to be changed is reported by getOptionWarnings.
+ *        If the MANIFEST is corrupt, nothing in dir is touched: see isOpened.
+ */
+KVStore::KVStore(const std::string &dir, const Options &_options): KVStoreAPI(dir)
 {
+    /* If "dir" does not exist, create it */
+    if (!utils::dirExists(dir))
+        utils::mkdir(dir.c_str());
+    options = _options;
+    checkOptions(dir);
+
     /* Initialize MemTable */
-    mem = new MemTable();
+    mem = new MemTable(options.bitsPerKey);
+    imm = nullptr;
+    immLogNumber = 0;
+    memLogNumber = 0;
+    isBgActive = false;
+    isClosing = false;
+    isSwitching = false;
+
+    /* Initialize the compaction policy and the amplification counters */
+    policy = CompactionPolicy::create(options);
+    bytesFlushed = 0;
+    bytesCompacted = 0;
+    bytesCompactionRead = 0;
+    gets = 0;
+    tablesProbed = 0;
+    readErrors = 0;
+
+    /* Initialize value cache shared by all SSTables */
+    cache = new BlockCache(options.cacheCapacity);
 
     /* Initialize the path in which the data store */
     dataDir = dir;
+    maxTimeStamp = 1;
+    wal = nullptr;
+    current = nullptr;
+    logNumber = 0;
+    lastSequence = 0;
+    visibleSequence = 0;
+    isOpen = true;
 
-    /* If "dir" does not exist, create it */
-    if (!utils::dirExists(dir))
-        utils::mkdir(dir.c_str());
+    /* Rebuild every level from the MANIFEST. A store written before the MANIFEST existed
+     * is loaded by scanning "dir/LevelN" once */
+    manifest = new Manifest(dir);
+    std::vector<FileMeta> files;
+    int levelNum = 0;
+    uint64_t nextTimeStamp;
+    if (manifest->exists() && !manifest->recover(files, nextTimeStamp, levelNum, logNumber)) {
+        /* Some live SSTables are unknown: deleting the files not referenced, or writing a new MANIFEST,
+         * would lose them */
+        isOpen = false;
+        installVersion();
+        bgThread = std::thread(&KVStore::backgroundWork, this);
+        return;
+    }
+    if (manifest->exists()) {
+        maxTimeStamp = nextTimeStamp;
+        levels.resize(levelNum);
+        /* The MANIFEST holds every header, so opening a file reads nothing from it */
+        std::vector<std::string> paths;
+        std::vector<SSInfo *> headers;
+        std::vector<int> tableLevels;
+        for (const FileMeta &meta : files) {
+            paths.push_back(levelPath(meta.level) + "/" + SSTable::fileName(meta.number));
+            headers.push_back(new SSInfo(meta.timeStamp, meta.size, meta.minKey, meta.maxKey));
+            tableLevels.push_back(meta.level);
+        }
+        std::vector<SSTable *> tables;
+        openTables(paths, headers, tables);
+        for (uint64_t i = 0; i < tables.size(); ++i) {
+            if (tables[i] == nullptr) continue;
+            if (tableLevels[i] >= (int) levels.size()) levels.resize(tableLevels[i] + 1);
+            addTable(tableLevels[i], tables[i]);
+        }
+        /* Drop what a crashed flush or compaction left behind */
+        removeObsoleteFiles();
+    }
+    else loadFromDirs();
+    installVersion();
+
+    /* Bring back the writes that were only in MemTable, and put them into SSTables */
+    memLogNumber = logNumber;
+    recoverLogs(logNumber);
+    if (imm == nullptr && !mem->isEmpty()) {
+        switchMemTable();
+        if (flushImm() && isToCompact()) compact();
+    }
+    newLog();
+    /* Replayed pairs that could not be flushed stay in their logs */
+    if (imm == nullptr && mem->isEmpty()) memLogNumber = logNumber;
+
+    /* Start a fresh MANIFEST holding only the current version, then drop the replayed logs */
+    saveManifest();
+    removeLogs(0, (imm != nullptr) ? immLogNumber : memLogNumber);
+
+    /* Flush and compaction run here from now on */
+    bgThread = std::thread(&KVStore::backgroundWork, this);
+}
+
+KVStore::~KVStore()
+{
+    /* Let the background thread finish the pending flush, then flush what is left in place */
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        isClosing = true;
+    }
+    bgWork.notify_one();
+    bgThread.join();
+    /* An imm that could not be written is left to its log */
+    if (isOpen && imm == nullptr && !mem->isEmpty()) {
+        switchMemTable();
+        if (flushImm() && isToCompact()) compact();
+    }
+    current->unref();
+    mem->unref();
+    if (imm != nullptr) imm->unref();
+    for (std::vector<SSTable *> &level : levels) {
+        for (SSTable *st : level)
+            st->unref();
+    }
+    delete cache;
+    delete manifest;
+    delete wal;
+    delete policy;
+}
+
+/**
+ * @brief Replay the logs numbered minLogNumber or above into MemTable, oldest first.
+ *        maxTimeStamp is moved past every log found, lastSequence past every pair replayed.
+ */
+void KVStore::recoverLogs(uint64_t minLogNumber)
+{
+    std::vector<std::string> fileVec;
+    std::vector<uint64_t> logs;
+    utils::scanDir(dataDir, fileVec);
+    for (const std::string &name : fileVec) {
+        uint64_t number;
+        if (!WAL::parseNumber(name, number)) continue;
+        if (number >= maxTimeStamp) maxTimeStamp = number + 1;
+        if (number >= minLogNumber) logs.push_back(number);
+    }
+    std::sort(logs.begin(), logs.end());
+
+    std::vector<std::pair<uint64_t, std::string>> ops;
+    for (uint64_t number : logs) {
+        WAL::replay(dataDir + "/" + WAL::fileName(number), ops);
+        for (const std::pair<uint64_t, std::string> &op : ops)
+            applyPut(op.first, op.second, ++lastSequence);
+    }
+    visibleSequence = lastSequence;
+}
+
+/**
+ * @brief Options saved in "dir/OPTIONS" by the last open, the defaults if there are none (or they do not parse)
+ */
+Options KVStore::savedOptions(const std::string &dir)
+{
+    Options saved;
+    saved.load(dir);
+    return saved;
+}
+
+/**
+ * @brief Clamp options into range, keep what can not change on an existing store, and save them to "dir/OPTIONS".
+ *        An OPTIONS file that does not parse is left as it is. Every change is added to optionWarnings.
+ */
+void KVStore::checkOptions(const std::string &dir)
+{
+    optionWarnings.clear();
+    options.sanitize(&optionWarnings);
+    if (utils::fileExists(dir + "/" + OPTIONS_NAME)) {
+        Options saved;
+        if (!saved.load(dir)) {
+            optionWarnings.push_back(std::string(OPTIONS_NAME) + " does not parse, left unchanged");
+            return;
+        }
+        saved.sanitize();
+        /* The levels of the store are laid out for its compaction style */
+        if (saved.compactionStyle != options.compactionStyle) {
+            optionWarnings.push_back("compaction_style=" + std::to_string(options.compactionStyle) + " changed to "
+                                     + std::to_string(saved.compactionStyle) + ", the style of the store");
+            options.compactionStyle = saved.compactionStyle;
+        }
+    }
+    if (!options.save(dir))
+        optionWarnings.push_back(std::string(OPTIONS_NAME) + " could not be saved");
+}
+
+/**
+ * @brief Open a new log for MemTable writes. The old log is closed but not deleted.
+ *        Its records are numbered after every earlier one: a flush that failed during recovery leaves
+ *        replayed pairs in mem, and a later write to one of their keys must still win.
+ */
+void KVStore::newLog()
+{
+    if (wal != nullptr) lastSequence = wal->getLastSequence();
+    delete wal;
+    logNumber = maxTimeStamp++;
+    wal = new WAL(dataDir + "/" + WAL::fileName(logNumber), options.syncMode, lastSequence);
+}
+
+/**
+ * @brief Delete the logs numbered in [begin, end)
+ */
+void KVStore::removeLogs(uint64_t begin, uint64_t end)
+{
+    std::vector<std::string> fileVec;
+    utils::scanDir(dataDir, fileVec);
+    for (const std::string &name : fileVec) {
+        uint64_t number;
+        if (WAL::parseNumber(name, number) && number >= begin && number < end)
+            utils::rmfile((dataDir + "/" + name).c_str());
+    }
+}
+
+/**
+ * @brief Open the SSTables at paths, spread over up to MAX_OPEN_THREADS threads. Opening only reads the header
+ *        of a file, and not even that if it is given; filters and indexes are loaded when first used.
+ * @param headers header of each file (taken over by its SSTable), or nullptr to read it; empty: read them all
+ * @param tables set to the SSTable of each path, nullptr if the file is missing
+ */
+void KVStore::openTables(const std::vector<std::string> &paths, std::vector<SSInfo *> &headers,
+                         std::vector<SSTable *> &tables)
+{
+    uint64_t num = paths.size();
+    tables.assign(num, nullptr);
+    headers.resize(num, nullptr);
+    std::atomic<uint64_t> next(0);
+    auto openPart = [&]() {
+        for (uint64_t i = next++; i < num; i = next++) {
+            if (!utils::fileExists(paths[i])) {
+                delete headers[i];
+                continue;
+            }
+            tables[i] = new SSTable(paths[i], cache, options.useMmap, headers[i]);
+        }
+    };
+
+    uint64_t threads = std::min<uint64_t>(MAX_OPEN_THREADS, (num + OPEN_MIN_TABLES - 1) / OPEN_MIN_TABLES);
+    std::vector<std::thread> workers;
+    for (uint64_t t = 1; t < threads; ++t)
+        workers.push_back(std::thread(openPart));
+    openPart();
+    for (std::thread &worker : workers)
+        worker.join();
+}
 
-    /* If "dir/Level0" exists, load SSTables from disk to generate cache, and set maxTimeStamp */
+/**
+ * @brief Load SSTables by scanning "dir/LevelN" (stores without a MANIFEST), and set maxTimeStamp
+ */
+void KVStore::loadFromDirs()
+{
     int currentLevel = 0;
-    std::string dirPath = dir + "/Level0";
-    if (utils::dirExists(dirPath)) {
-        maxTimeStamp = 0;
-        SSVec.clear();
+    std::string dirPath = levelPath(0);
+    std::vector<std::string> fileVec;
+    std::vector<std::string> paths;
+    std::vector<int> tableLevels;
+    while (utils::dirExists(dirPath)) {
+        levels.push_back(std::vector<SSTable *>());
+        utils::scanDir(dirPath, fileVec);
+        for (const std::string &name : fileVec) {
+            paths.push_back(dirPath + "/" + name);
+            tableLevels.push_back(currentLevel);
+        }
+        /* Update dir path */
+        dirPath = levelPath(++currentLevel);
+        /* Clear fileVec */
+        fileVec.clear();
+    }
+
+    /* Open every SSTable found, their headers are read in parallel */
+    std::vector<SSInfo *> headers;
+    std::vector<SSTable *> tables;
+    openTables(paths, headers, tables);
+    for (uint64_t i = 0; i < tables.size(); ++i) {
+        SSTable *st = tables[i];
+        if (st == nullptr) continue;
+        addTable(tableLevels[i], st);
+        /* Set maxTimeStamp (file numbers come from the same counter) */
+        SSInfo *h = st->returnHeader();
+        if (h->timeStamp >= maxTimeStamp)
+            maxTimeStamp = h->timeStamp + 1;
+        if (st->returnNumber() >= maxTimeStamp)
+            maxTimeStamp = st->returnNumber() + 1;
+    }
+}
+
+/**
+ * @brief Delete files under "dir/LevelN" that the recovered version does not reference:
+ *        outputs of a flush/compaction whose edit was never logged, and inputs of a logged
+ *        compaction that were not deleted yet. Missing level directories are recreated.
+ */
+void KVStore::removeObsoleteFiles()
+{
+    for (int level = 0; level < (int) levels.size(); ++level) {
+        std::string dirPath = levelPath(level);
+        if (!utils::dirExists(dirPath)) {
+            utils::mkdir(dirPath.c_str());
+            continue;
+        }
         std::vector<std::string> fileVec;
-        /* Enter directories and load SSTables to cache */
-        while (utils::dirExists(dirPath)) {
-            utils::scanDir(dirPath, fileVec);
-            uint64_t size = fileVec.size();
-            /* Load every SSTables in this dir to cache */
-            for (int i = 0; i < size; ++i) {
-                std::string filePath = dirPath + "/" + fileVec[i];
-                SSTable *st = new SSTable(filePath);
-                SSVec.push_back(st);
-                /* Set maxTimeStamp */
-                SSInfo *h = st->returnHeader();
-                if (h->timeStamp >= maxTimeStamp)
-                    maxTimeStamp = h->timeStamp + 1;
+        utils::scanDir(dirPath, fileVec);
+        for (const std::string &name : fileVec) {
+            bool isLive = false;
+            for (SSTable *st : levels[level]) {
+                if (SSTable::fileName(st->returnNumber()) == name) {
+                    isLive = true;
+                    break;
+                }
             }
-            /* Update dir path */
-            dirPath = dir + "/Level" + std::to_string(++currentLevel);
-            /* Clear fileVec */
-            fileVec.clear();
+            if (!isLive) utils::rmfile((dirPath + "/" + name).c_str());
+        }
+    }
+    /* Directories of levels that were never logged */
+    for (int level = (int) levels.size(); utils::dirExists(levelPath(level)); ++level) {
+        std::vector<std::string> fileVec;
+        utils::scanDir(levelPath(level), fileVec);
+        for (const std::string &name : fileVec)
+            utils::rmfile((levelPath(level) + "/" + name).c_str());
+        utils::rmdir(levelPath(level).c_str());
+    }
+}
+
+/**
+ * @brief What the MANIFEST records about st
+ */
+FileMeta KVStore::tableMeta(int level, SSTable *st)
+{
+    SSInfo *h = st->returnHeader();
+    return FileMeta(level, st->returnNumber(), h->timeStamp, h->size, h->minKey, h->maxKey);
+}
+
+/**
+ * @brief Replace the MANIFEST with a snapshot of the current levels
+ * @return true if the new MANIFEST is in place
+ */
+bool KVStore::saveManifest()
+{
+    std::vector<FileMeta> files;
+    for (int level = 0; level < (int) levels.size(); ++level) {
+        for (SSTable *st : levels[level])
+            files.push_back(tableMeta(level, st));
+    }
+    return manifest->writeSnapshot(files, maxTimeStamp, (int) levels.size(),
+                                   (imm != nullptr) ? immLogNumber : memLogNumber);
+}
+
+/**
+ * @brief Append edit to the MANIFEST. If that fails, the MANIFEST is rewritten from the installed version,
+ *        so whatever part of the edit reached the disk does not count. Called with mutex held.
+ * @return true if edit is durable and may be installed
+ */
+bool KVStore::logEdit(const VersionEdit &edit)
+{
+    if (manifest->logEdit(edit)) return true;
+    saveManifest();
+    return false;
+}
+
+/**
+ * @brief Turn mem into imm and give writes a new MemTable (and a new log, unless recovering).
+ *        imm must be nullptr. Called with mutex held, or before/after the background thread runs.
+ */
+void KVStore::switchMemTable()
+{
+    imm = mem;
+    immLogNumber = memLogNumber;
+    mem = new MemTable(options.bitsPerKey);
+    if (wal != nullptr) {
+        newLog();
+        memLogNumber = logNumber;
+    }
+    installVersion();
+}
+
+/**
+ * @brief Publish mem, imm and levels as they are now as the Version readers get.
+ *        Called after each change, with mutex held (or while the background thread is not running).
+ */
+void KVStore::installVersion()
+{
+    Version *v = new Version(mem, imm, levels);
+    Version *old;
+    {
+        std::lock_guard<std::mutex> lk(versionLock);
+        old = current;
+        current = v;
+    }
+    if (old != nullptr) old->unref();
+}
+
+/**
+ * @brief The current Version, ref'ed for the caller, who unrefs it when done. Never waits for a flush or compaction.
+ */
+Version *KVStore::currentVersion()
+{
+    std::lock_guard<std::mutex> lk(versionLock);
+    current->ref();
+    return current;
+}
+
+/**
+ * @brief Write imm into a new SSTable of level0, log it in the MANIFEST and install it.
+ *        The SSTable is written without the lock; readers keep finding the pairs in imm until it is installed.
+ * @return false if it could not be written or logged: imm and its logs are kept, to be flushed again later
+ */
+bool KVStore::flushImm()
+{
+    std::string dirPath = levelPath(0);
+    if (!utils::dirExists(dirPath))
+        utils::mkdir(dirPath.c_str());
+    /* Store some parts of sstable in cache and write whole to disk */
+    uint64_t number = maxTimeStamp++;
+    std::string path = dirPath + "/" + SSTable::fileName(number);
+    SSTable *st = imm->createSSTable(number, path, cache, options.useMmap, compressionOf(0), options.blockSize);
+    if (st == nullptr) return false;
+
+    std::unique_lock<std::mutex> lk(mutex);
+    if (levels.empty())
+        levels.push_back(std::vector<SSTable *>());
+    VersionEdit edit;
+    edit.addFile(tableMeta(0, st));
+    edit.setNextTimeStamp(maxTimeStamp);
+    edit.setLevelNum((int) levels.size());
+    edit.setLogNumber(memLogNumber);
+    if (!logEdit(edit)) {
+        lk.unlock();
+        /* The file stays: the next open drops it unless the edit did reach the MANIFEST */
+        st->unref();
+        return false;
+    }
+    bytesFlushed += st->fileSize();
+    addTable(0, st);
+    imm->unref();
+    imm = nullptr;
+    installVersion();
+    /* A writer may switch the MemTable again as soon as the lock is released */
+    uint64_t oldLogNumber = immLogNumber;
+    uint64_t newLogNumber = memLogNumber;
+    lk.unlock();
+    bgDone.notify_all();
+
+    /* The pairs of the old logs are in the SSTable now (during recovery the logs are still being replayed) */
+    removeLogs(oldLogNumber, newLogNumber);
+    return true;
+}
+
+bool KVStore::hasImm()
+{
+    std::lock_guard<std::mutex> lk(mutex);
+    return imm != nullptr;
+}
+
+/**
+ * @brief Body of the background thread: flush imm whenever it is set, then compact if level0 is full.
+ *        Returns when the store is closing and no imm is left, or the last one could not be flushed.
+ */
+void KVStore::backgroundWork()
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    while (true) {
+        while (imm == nullptr && !isClosing)
+            bgWork.wait(lk);
+        if (imm == nullptr) break;
+        isBgActive = true;
+        lk.unlock();
+
+        bool isFlushed = flushImm();
+        if (isFlushed && isToCompact()) compact();
+
+        lk.lock();
+        isBgActive = false;
+        bgDone.notify_all();
+        /* imm is still in its log: try again a little later, or leave it there if the store is closing */
+        if (!isFlushed) {
+            if (isClosing) break;
+            bgWork.wait_for(lk, std::chrono::milliseconds(BG_RETRY_MS));
         }
     }
-    /* Else just set TimeStamp to 1 */
+}
+
+/**
+ * @param level level number
+ * @return The directory that holds SSTables of this level
+ */
+std::string KVStore::levelPath(int level)
+{
+    return dataDir + "/Level" + std::to_string(level);
+}
+
+/**
+ * @return Codec of the data blocks of new SSTables in this level
+ */
+CompressionType KVStore::compressionOf(int level)
+{
+    return options.compression[std::min<uint64_t>(level, options.compression.size() - 1)];
+}
+
+/**
+ * @brief Insert SSTable into levels[level], keeping the order of the level.
+ *        Level0: newest first (bigger timeStamp first). Other levels: smaller minKey first.
+ * @param level level number, levels[level] must exist
+ * @param st SSTable to be inserted
+ */
+void KVStore::addTable(int level, SSTable *st)
+{
+    std::vector<SSTable *> &tables = levels[level];
+    SSInfo *h = st->returnHeader();
+    auto pos = tables.begin();
+    if (level == 0) {
+        while (pos != tables.end() && (*pos)->returnHeader()->timeStamp > h->timeStamp) ++pos;
+    }
     else {
-        maxTimeStamp = 1;
+        while (pos != tables.end() && (*pos)->returnHeader()->minKey < h->minKey) ++pos;
     }
+    tables.insert(pos, st);
 }
 
-KVStore::~KVStore()
+/**
+ * @brief Remove SSTable from levels[level]; its file and index go away once no reader holds it.
+ *        Its entries in the block cache are left to age out: their id is never used again, so nothing hits them
+ * @param level level number
+ * @param st SSTable to be removed
+ */
+void KVStore::removeTable(int level, SSTable *st)
 {
-    std::string dirPath = dataDir + "/Level0";
-    std::string path = dirPath + "/sstable" + std::to_string(maxTimeStamp) + ".sst";
-    mem->createSSTable(SSVec, maxTimeStamp++, path);
-    if (isToCompact()) compact();
+    std::vector<SSTable *> &tables = levels[level];
+    for (auto it = tables.begin(); it != tables.end(); ++it) {
+        if (*it == st) {
+            tables.erase(it);
+            break;
+        }
+    }
+    st->markObsolete();
+    st->unref();
 }
 
 /**
@@ -66,14 +556,16 @@ KVStore::~KVStore()
 bool KVStore::isOverflow(uint64_t key, const std::string &str)
 {
     int size = mem->getByteSize();
+    /* Values rewritten with longer ones leave their old bytes in the arena */
+    if (!mem->isEmpty() && mem->memoryUsage() + str.length() > MAX_ARENA_FACTOR * options.memTableBytes) return true;
     std::string pStr = mem->get(key);
     /* Key not found or has been deleted */
     if (pStr == "") {
-        return size + str.length() + 12 > MAX_BYTE;                 //Insert a new MemNode
+        return size + str.length() + 12 > options.memTableBytes;                 //Insert a new MemNode
     }
     /* Key found */
     else {
-        return size + str.length() - pStr.length() > MAX_BYTE;      //Update the val of the original MemNode
+        return size + str.length() - pStr.length() > options.memTableBytes;      //Update the val of the original MemNode
     }
 }
 
@@ -83,389 +575,582 @@ bool KVStore::isOverflow(uint64_t key, const std::string &str)
  */
 bool KVStore::isToCompact()
 {
-    std::string dirPath = dataDir + "/Level0";
-    std::vector<std::string> fileVec;
-    utils::scanDir(dirPath, fileVec);
-    /* Files num in level0 <= 2, not to compact */
-    if (fileVec.size() <= 2) return false;
-    /* Else to compact */
-    else return true;
+    CompactionJob job;
+    return policy->pick(levels, job);
 }
 
 /**
- * This function is invoked when there are more than 2 files in level0.
- * @brief Conduct compaction operation.
+ * This function is invoked by the background thread after a flush.
+ * @brief Run the compactions the policy picks until it finds nothing left to compact.
  */
 void KVStore::compact()
 {
-    int currentLevel = 0;                       //Maintain current directory's level
-    int maxFilesNum;                            //Max number of files in current directory: 2 ^ (currentLevel + 1)
-    int currentFilesNum;                        //The number of files in current directory
-    std::vector<SSTable *> compactSSVec;          //Get cache files that need to be compacted under current directory
-    std::vector<std::string> fileVec;           //Get files' name under current directory
-    std::string dirPath = dataDir + "/Level0";      //Next directory to be visited
-
-    /* Perform compaction operation */
-    while (utils::dirExists(dirPath)) {
-        utils::scanDir(dirPath, fileVec);
-        currentFilesNum = fileVec.size();
-        maxFilesNum = 2 << currentLevel;
-        /* If the number of files in current directory outnumbers 2 ^ (currentLevel + 1), do compaction */
-        if (fileVec.size() > maxFilesNum) {
-            /******* Select compact files and put them into compactVec *******/
-            /* If the level of dir is 0; compactVec = fileVec */
-            int SSVecSize = SSVec.size();
-            if (currentLevel == 0) {
-                for (int i = 0; i < currentFilesNum; ++i) {
-                    fileVec[i] = dirPath + "/" + fileVec[i];
-                    std::string p1 = fileVec[i];
-                    for (int j = 0 ; j < SSVecSize; ++j) {
-                        std::string p2 = SSVec[j]->returnPath();
-                        if (p1 == p2) compactSSVec.push_back(SSVec[j]);
-                    }
-                }
-            }
-            /* Else select (2 ^ (currentLevel + 1) - maxFilesNum) files and insert them into compactVec.
-             * Those files have minimum timeStamp in the current directories */
-            else {
-                int compactFileNum = currentFilesNum - maxFilesNum;
-                int SSVecSize = SSVec.size();
-                std::vector<SSTable *> fileSSVec;               //Corresponding cache for path in fileVec
-                /* Add corresponding cache to fileSSVec (using the path in fileVec) */
-                for (int i = 0; i < currentFilesNum; ++i) {
-                    fileVec[i] = dirPath + "/" + fileVec[i];
-                    std::string p1 = fileVec[i];
-                    for (int j = 0 ; j < SSVecSize; ++j) {
-                        std::string p2 = SSVec[j]->returnPath();
-                        if (p1 == p2) fileSSVec.push_back(SSVec[j]);
-                    }
-                }
-                /* Sort fileSSVec from small to big according to timeStamp */
-                for (int i = 1; i < currentFilesNum; ++i) {
-                    for (int j = 0; j < currentFilesNum - i; ++j) {
-                        /* Select according to timeStamp */
-                        if (fileSSVec[j+1]->returnHeader()->timeStamp
-                                < fileSSVec[j]->returnHeader()->timeStamp)
-                        {
-                            SSTable *tmp;
-                            tmp = fileSSVec[j];
-                            fileSSVec[j] = fileSSVec[j+1];
-                            fileSSVec[j+1] = tmp;
-                        }
-                        /* If timestamp is equal, select SSTable that has smaller minKey */
-                        else if (fileSSVec[j+1]->returnHeader()->timeStamp == fileSSVec[j]->returnHeader()->timeStamp
-                                    && fileSSVec[j+1]->returnHeader()->minKey < fileSSVec[j]->returnHeader()->minKey)
-                        {
-                            SSTable *tmp;
-                            tmp = fileSSVec[j];
-                            fileSSVec[j] = fileSSVec[j+1];
-                            fileSSVec[j+1] = tmp;
-                        }
-                    }
-                }
-                /* Select compactFileNum elements(in sequence) in fileSSVec */
-                for (int i = 0; i < compactFileNum; ++i) {
-                    compactSSVec.push_back(fileSSVec[i]);
-                }
-            }
-
-            /********* Start to compact files into next level **************/
-            std::string nextDirPath = dataDir + "/Level" + std::to_string(currentLevel + 1);
-            std::vector<std::string> nextFileVec;
-            std::vector<SSTable *> nextFileSSVec;
-            std::vector<KVArray *> KVArrayVec;
-            /* Current level is the last level. Create a new directory and do a compaction that deletes "~DELETE~" symbols */
-            if (!utils::dirExists(nextDirPath)) {
-                /* Since there are no files in next dir, we do not need to find files in next dir. */
-                /* Create next dir */
-                utils::mkdir(nextDirPath.c_str());
-                /* Get KVArrays for every cache in compactSSVec */
-                uint64_t KVArraysNum = compactSSVec.size();
-                for (int i = 0; i < KVArraysNum; ++i) {
-                    KVArray * kv = new KVArray(compactSSVec[i], KVReadMode::RMDELETE);
-                    KVArrayVec.push_back(kv);
-                }
-                /* Deallocate those cache in compactSSVec because their corresponding SSTable in disk will be deleted */
-                uint64_t comPactSSVecSize = compactSSVec.size();
-                for (int i = 0; i < comPactSSVecSize; ++i) {
-                    std::string deleteFilePath = compactSSVec[i]->returnPath();
-                    uint64_t SSVecSize = SSVec.size();
-                    for (int j = 0; j < SSVecSize; ++j) {
-                        if (deleteFilePath == SSVec[j]->returnPath()) {
-                            SSVec[j]->reset();                          // delete files and deallocate memory in cache
-                            SSVec.erase(SSVec.begin() + j);
-                            break;
-                        }
-                    }
-                }
+    CompactionJob job;
+    while (true) {
+        /* A full MemTable goes first: writers are waiting on it */
+        if (hasImm()) flushImm();
+        /* A compaction that could not be logged is tried again after the next flush */
+        if (!policy->pick(levels, job) || !runCompaction(job)) break;
+    }
+}
 
-                /* Combine K-Way K-V pair arrays. Write the result into a MemTable and generate SSTable. */
-                kwayCombine(KVArrayVec, nextDirPath);
+/**
+ * @brief Merge the inputs of job into new SSTables of its output level and install them in place of the inputs.
+ *        Inputs that overlap nothing they would be merged with are moved to the output level as they are.
+ * @return false if an input could not be read whole, or the outputs could not be written or logged:
+ *         the inputs stay installed
+ */
+bool KVStore::runCompaction(const CompactionJob &job)
+{
+    int outputLevel = job.outputLevel;
+    if (outputLevel >= (int) levels.size()) {
+        std::lock_guard<std::mutex> lk(mutex);
+        levels.resize(outputLevel + 1);
+    }
+    std::string outputDirPath = levelPath(outputLevel);
+    if (!utils::dirExists(outputDirPath))
+        utils::mkdir(outputDirPath.c_str());
 
+    /* Nothing older than the inputs is left below the output, so "~DELETE~" symbols are dropped there */
+    bool dropDelete = true;
+    for (int level = outputLevel + 1; level < (int) levels.size(); ++level) {
+        if (!levels[level].empty()) dropDelete = false;
+    }
+    if (outputLevel == 0) {
+        SSTable *oldest = levels[0].back();
+        dropDelete = dropDelete && std::find_if(job.inputs.begin(), job.inputs.end(),
+                                                [oldest](const std::pair<int, SSTable *> &input) {
+                                                    return input.second == oldest;
+                                                }) != job.inputs.end();
+    }
 
-            }
-            /* Current level is not the last level. Do a normal compaction */
-            else {
-                /* We need to find files in the next directory that have keys in the range [minkey, maxKey] */
-                uint64_t minKey = UINT64_MAX;
-                uint64_t maxKey = 0;
-                int compactFileNum = compactSSVec.size();
-                /* Calculate minKey and maxKey */
-                for (int i = 0; i < compactFileNum; ++i) {
-                    SSInfo *header = compactSSVec[i]->returnHeader();
-                    minKey = (minKey < header->minKey) ? minKey : header->minKey;
-                    maxKey = (maxKey > header->maxKey) ? maxKey : header->maxKey;
-                }
-                /* Get paths of next directory's files */
-                utils::scanDir(nextDirPath, nextFileVec);
-                int nextFileNum = nextFileVec.size();
-                /* Add corresponding cache files, which have key in range [minKey, maxKey], to compactSSVec */
-                for (int i = 0; i < nextFileNum; ++i) {
-                    std::string p1 = nextFileVec[i];
-                    for (int j = 0; j < SSVecSize; ++j) {
-                        SSInfo *header = SSVec[j]->returnHeader();
-                        std::string p2 = SSVec[j]->returnPath();
-                        if (p1 == p2 && !((header->minKey < minKey && header->maxKey < minKey) || (header->minKey > maxKey && header->maxKey > maxKey)))
-                            compactSSVec.push_back(SSVec[j]);
-                    }
-                }
-                /* Get KVArrays for every cache in compactSSVec */
-                uint64_t KVArraysNum = compactSSVec.size();
-                for (int i = 0; i < KVArraysNum; ++i) {
-                    KVArray * kv = new KVArray(compactSSVec[i], KVReadMode::NORMALLY);
-                    KVArrayVec.push_back(kv);
-                }
-                /* Deallocate those cache in compactSSVec because their corresponding SSTable in disk will be deleted */
-                uint64_t comPactSSVecSize = compactSSVec.size();
-                for (int i = 0; i < comPactSSVecSize; ++i) {
-                    std::string deleteFilePath = compactSSVec[i]->returnPath();
-                    uint64_t SSVecSize = SSVec.size();
-                    for (int j = 0; j < SSVecSize; ++j) {
-                        if (deleteFilePath == SSVec[j]->returnPath()) {
-                            SSVec[j]->reset();                          // delete files and deallocate memory in cache
-                            SSVec.erase(SSVec.begin() + j);
-                            break;
-                        }
-                    }
-                }
-                /* Combine K-Way K-V pair arrays. Write the result into a MemTable and generate SSTable. */
-                kwayCombine(KVArrayVec, nextDirPath);
+    /* The level below the output: where the outputs go next, so what their key ranges cost later */
+    std::vector<SSTable *> grandparents;
+    if (outputLevel > 0 && outputLevel + 1 < (int) levels.size())
+        grandparents = levels[outputLevel + 1];
 
-            }
+    /* Move: a second name for the file in the output level, the old one goes with the input SSTable */
+    std::vector<bool> isMoved;
+    pickTrivialMoves(job, dropDelete, grandparents, isMoved);
+    std::vector<SSTable *> moved;
+    for (uint64_t i = 0; i < job.inputs.size(); ++i) {
+        if (!isMoved[i]) continue;
+        SSTable *st = job.inputs[i].second;
+        std::string path = outputDirPath + "/" + SSTable::fileName(st->returnNumber());
+        if (utils::linkFile(st->returnPath().c_str(), path.c_str()) != 0) break;
+        moved.push_back(new SSTable(path, cache, options.useMmap, new SSInfo(*st->returnHeader())));
+    }
+    /* Could not link them all: merge everything */
+    if (moved.size() != (uint64_t) std::count(isMoved.begin(), isMoved.end(), true)) {
+        for (SSTable *st : moved) {
+            st->markObsolete();
+            st->unref();
+        }
+        moved.clear();
+        isMoved.assign(job.inputs.size(), false);
+    }
 
-            /**** Deallocate some vectors' memory which was allocated in the if expression ****/
-            /* KVArray */
-            uint64_t KVArraySize = KVArrayVec.size();
-            for (int i = 0 ; i < KVArraySize; ++i)
-                delete KVArrayVec[i];
+    /* Read every other input front to back, from the newest to the oldest */
+    std::vector<SSTable *> inputs;
+    uint64_t KVTimeStamp = 0;           //Max timeStamp in all inputs
+    for (uint64_t i = 0; i < job.inputs.size(); ++i) {
+        if (isMoved[i]) continue;
+        SSTable *st = job.inputs[i].second;
+        inputs.push_back(st);
+        KVTimeStamp = std::max(KVTimeStamp, st->returnHeader()->timeStamp);
+        bytesCompactionRead += st->fileSize();
+        /* The mapping is shared with readers, but the file is read front to back and goes once this is installed.
+         * If the compaction fails, the inputs stay: restoreInputs sets the advice back */
+        st->load();
+        st->advise(utils::MAP_SEQUENTIAL);
+    }
+    auto restoreInputs = [&inputs]() {
+        for (SSTable *st : inputs)
+            st->advise(utils::MAP_RANDOM);
+    };
 
+    /* Big compactions are cut into key ranges merged side by side, each with its own iterators.
+     * This thread takes the first range and keeps flushing imm meanwhile.
+     * Level0 takes the output as one file, so it is never cut */
+    std::vector<uint64_t> bounds;
+    if (outputLevel > 0) splitCompaction(inputs, bounds);
+    uint64_t maxFileBytes = (outputLevel > 0) ? options.memTableBytes : UINT64_MAX;
+    std::vector<std::vector<SSTable *>> partOutputs(bounds.size() + 1);
+    std::atomic<bool> isWritten(true);
+    auto mergePart = [&](uint64_t part, bool flushImms) {
+        std::vector<Iterator *> iterVec;
+        for (SSTable *st : inputs)
+            iterVec.push_back(new SSTableIterator(st));
+        MergingIterator *input = new MergingIterator(iterVec);
+        uint64_t begin = (part == 0) ? 0 : bounds[part - 1];
+        uint64_t end = (part == bounds.size()) ? UINT64_MAX : bounds[part] - 1;
+        if (!kwayCombine(input, begin, end, KVTimeStamp, outputLevel, dropDelete, flushImms, maxFileBytes,
+                         grandparents, partOutputs[part]))
+            isWritten = false;
+        /* An input that could not be read whole would lose the pairs it skipped once it is deleted */
+        if (input->hasError()) isWritten = false;
+        /* The inputs may be freed below */
+        delete input;
+    };
+    if (!inputs.empty()) {
+        std::vector<std::thread> workers;
+        for (uint64_t part = 1; part <= bounds.size(); ++part)
+            workers.push_back(std::thread(mergePart, part, false));
+        mergePart(0, true);
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+    std::vector<SSTable *> outputs;
+    for (std::vector<SSTable *> &part : partOutputs)
+        outputs.insert(outputs.end(), part.begin(), part.end());
+    outputs.insert(outputs.end(), moved.begin(), moved.end());
+    /* Some output is missing: nothing refers to the others yet */
+    if (!isWritten) {
+        for (SSTable *st : outputs) {
+            st->markObsolete();
+            st->unref();
         }
-        /* Else simply break the loop */
-        else break;
-        /* Set dirPath to the next directory */
-        dirPath = dataDir + "/Level" + std::to_string(++currentLevel);
-        /* Clear vectors */
-        compactSSVec.clear();
-        fileVec.clear();
+        restoreInputs();
+        return false;
     }
+    for (std::vector<SSTable *> &part : partOutputs) {
+        for (SSTable *st : part)
+            bytesCompacted += st->fileSize();
+    }
+
+    /* Log the whole compaction as one edit: until it is on disk, the inputs are the live version.
+     * Readers see either the inputs or the outputs, and the inputs stay on disk until no reader holds them */
+    std::unique_lock<std::mutex> lk(mutex);
+    VersionEdit edit;
+    for (SSTable *st : outputs)
+        edit.addFile(tableMeta(outputLevel, st));
+    for (const std::pair<int, SSTable *> &input : job.inputs)
+        edit.delFile(input.first, input.second->returnNumber());
+    edit.setNextTimeStamp(maxTimeStamp);
+    edit.setLevelNum((int) levels.size());
+    if (!logEdit(edit)) {
+        lk.unlock();
+        /* Nothing is deleted: the next open drops the outputs unless the edit did reach the MANIFEST */
+        for (SSTable *st : outputs)
+            st->unref();
+        restoreInputs();
+        return false;
+    }
+    for (SSTable *st : outputs)
+        addTable(outputLevel, st);
+
+    /* The inputs are deleted once no reader holds them; their block cache entries age out */
+    for (const std::pair<int, SSTable *> &input : job.inputs)
+        removeTable(input.first, input.second);
+    installVersion();
+    return true;
 }
 
 /**
- * @brief Combine K-Way K-V pair arrays. Write the result into a MemTable and generate SSTable.
- * @param Arr Combine source (The Vector that we store our KVArray in)
- * @param dirPath The dir path that we write SSTable into
+ * @brief Find the inputs of job that can go to its output level unchanged: not from that level, overlapping
+ *        no other input and not the key range of what the rest merges into, not more than
+ *        MAX_GRANDPARENT_OVERLAP_FILES SSTables worth of grandparents, and holding no "~DELETE~" that would be dropped.
+ * @param grandparents SSTables of the level below the output level
+ * @param isMoved set to whether each input of job is moved
  */
-void KVStore::kwayCombine(std::vector<KVArray *> &Arr, const std::string &dirPath)
+void KVStore::pickTrivialMoves(const CompactionJob &job, bool dropDelete, const std::vector<SSTable *> &grandparents,
+                               std::vector<bool> &isMoved)
 {
-    bool isContinue = true;
-    int KVArraysNum = Arr.size();
-    std::vector<KWayNode *> KWayBuf;    //K-Way combination's buffer
-    uint64_t KVTimeStamp = 0;           //Max timeStamp in all KVArrays
-    MemTable *m = new MemTable;         //For generate SSTable
-
-    /* Get the max timeStamp in all KVArrays */
-    uint64_t arrSize = Arr.size();
-    for (int i = 0; i < arrSize; ++i) {
-        uint64_t timeStamp = Arr[i]->timeStamp;
-        KVTimeStamp = (KVTimeStamp > timeStamp) ? KVTimeStamp : timeStamp;
-    }
-    /* Load the first element in every KVArray */
-    for (int i = 0; i < KVArraysNum; ++i) {
-        uint64_t index = Arr[i]->cachePos;
-        KWayNode *node = new KWayNode(i, Arr[i]->timeStamp, Arr[i]->KVCache[index]);
-        KWayBuf.push_back(node);
-    }
-    /* K-Way Combine */
-    while (isContinue){
-        isContinue = false;
-        int KWayBufSize = KWayBuf.size();
-        /********** Bubble Sort *************/
-        for (int i = 1; i < KWayBufSize; ++i) {
-            for (int j = 0; j < KWayBufSize - i; ++j) {
-                if (KWayBuf[j]->KVNode.first > KWayBuf[j+1]->KVNode.first) {
-                    KWayNode *tmp = KWayBuf[j];
-                    KWayBuf[j] = KWayBuf[j+1];
-                    KWayBuf[j+1] = tmp;
-                }
-            }
+    uint64_t num = job.inputs.size();
+    isMoved.assign(num, false);
+    if (job.outputLevel == 0) return;
+    uint64_t maxOverlapBytes = MAX_GRANDPARENT_OVERLAP_FILES * options.memTableBytes;
+    for (uint64_t i = 0; i < num; ++i) {
+        SSTable *st = job.inputs[i].second;
+        SSInfo *h = st->returnHeader();
+        uint64_t overlapBytes = 0;
+        for (SSTable *gp : grandparents) {
+            SSInfo *g = gp->returnHeader();
+            if (!(g->maxKey < h->minKey || g->minKey > h->maxKey)) overlapBytes += gp->fileSize();
         }
+        isMoved[i] = job.inputs[i].first != job.outputLevel && overlapBytes <= maxOverlapBytes
+                     && !(dropDelete && st->hasDeletes());
+    }
 
-        /******* Deal with the KWayBuf which was newly sorted (buffer for K-Way Combination) *********/
-        std::vector<uint64_t> updateVec;                    // Index in KWayBuf to be updated
-        uint64_t minKey = KWayBuf[0]->KVNode.first;         // Min key in KWayBuf
-        uint64_t selectTimeStamp = 0;                       // Max timeStamp in the first few KWayNodes
-        uint64_t reserveIndex = 0;                          // The Index of KWayNode that is reserved
-
-        /* Determine which KWayNode is to be updated and Store their index in updateVec */
-        for (uint64_t i = 0; i < KWayBufSize; ++i) {
-            /* The nodes have same key with the first KWayNode */
-            if (KWayBuf[i]->KVNode.first == minKey) {
-                updateVec.push_back(i);
-                /* Check timeStamp and update reserveIndex and maxTimeStamp(selectTimeStamp) */
-                if (KWayBuf[i]->timeStamp > selectTimeStamp) {
-                    reserveIndex = i;
-                    selectTimeStamp = KWayBuf[i]->timeStamp;
-                }
-            }
-            /* Else break */
-            else break;
+    /* Every input kept back widens the merged range, which may catch more of them */
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        uint64_t minKey = UINT64_MAX;
+        uint64_t maxKey = 0;
+        for (uint64_t i = 0; i < num; ++i) {
+            if (isMoved[i]) continue;
+            SSInfo *h = job.inputs[i].second->returnHeader();
+            minKey = std::min(minKey, h->minKey);
+            maxKey = std::max(maxKey, h->maxKey);
         }
-
-        /* Store key and value of the element which has minimum element */
-        minKey = KWayBuf[reserveIndex]->KVNode.first;                                   // key of the minimum element
-        std::string valForMinKey = KWayBuf[reserveIndex]->KVNode.second;                   // value of the minimum element
-
-        /* Update KWayNode having index in updateVec */
-        uint64_t updateVecSize = updateVec.size();
-        for (uint64_t i = 0 ; i< updateVecSize; ++i) {
-            uint64_t arrIndex = KWayBuf[updateVec[i]]->KWayArrayIndex;
-            uint64_t KVCachePos = ++Arr[arrIndex]->cachePos;           // Update current cachePos
-            /* If is to overflow: Set overflow flag to true (although it doesn't work in the following steps) */
-            if (KVCachePos >= Arr[arrIndex]->cacheSize) {
-                Arr[arrIndex]->isOverFlow = true;
+        for (uint64_t i = 0; i < num; ++i) {
+            if (!isMoved[i]) continue;
+            SSInfo *h = job.inputs[i].second->returnHeader();
+            bool isOverlap = !(h->maxKey < minKey || h->minKey > maxKey);
+            for (uint64_t j = 0; j < num && !isOverlap; ++j) {
+                SSInfo *other = job.inputs[j].second->returnHeader();
+                isOverlap = j != i && isMoved[j] && !(h->maxKey < other->minKey || h->minKey > other->maxKey);
             }
-            /* Not to overflow: Push the next element into KWayBuf */
-            else {
-                KWayNode *kWayNode = new KWayNode(arrIndex, Arr[arrIndex]->timeStamp, Arr[arrIndex]->KVCache[KVCachePos]);
-                KWayBuf.push_back(kWayNode);
+            if (isOverlap) {
+                isMoved[i] = false;
+                isChanged = true;
             }
         }
+    }
+}
 
-        /* Erase those KWayNode having index in updateVec */
-        for (int i = updateVecSize - 1; i >= 0; --i) {
-            delete KWayBuf[updateVec[i]];
-            KWayBuf.erase(KWayBuf.cbegin() + updateVec[i]);
-        }
+/**
+ * @brief Cut the key range of a compaction into parts with about the same number of pairs, one per merging thread:
+ *        at most MAX_SUBCOMPACTIONS, and SUBCOMPACTION_MIN_FILES SSTables worth of input each. The cut points are taken from
+ *        the min keys of the inputs and every SUBCOMPACTION_SAMPLE-th key of their dictionaries.
+ * @param bounds set to the first key of every part but the first, ascending (empty: one part)
+ */
+void KVStore::splitCompaction(const std::vector<SSTable *> &inputs, std::vector<uint64_t> &bounds)
+{
+    bounds.clear();
+    uint64_t bytes = 0;
+    for (SSTable *st : inputs)
+        bytes += st->fileSize();
+    uint64_t parts = std::min<uint64_t>(MAX_SUBCOMPACTIONS, bytes / (SUBCOMPACTION_MIN_FILES * options.memTableBytes));
+    if (parts <= 1) return;
 
-        /****** Insert the minimum K-V node into memtable (and generate cache, SSTable). ********/
-        /* Whether overflow or not? */
-        bool isToOverflow = false;
-        int mSize = m->getByteSize();
-        std::string pStr = m->get(minKey);
-        /* Key not found or has been deleted */
-        if (pStr == "") isToOverflow = (mSize + valForMinKey.length() + 12 > MAX_BYTE);                 //Insert a new MemNode
-        /* Key found */
-        else isToOverflow =  (mSize + valForMinKey.length() - pStr.length() > MAX_BYTE);      //Update the val of the original MemNode
-        /* Insert K-V node, deal with overflow and create new cache for SSTable in disk */
-        /* If is to overflow */
-        if (isToOverflow) {
-            std::string path = dirPath + "/sstable" + std::to_string(maxTimeStamp++) + ".sst";
-            /* Create cache and write SSTable to disk */
-            m->createSSTable(SSVec, KVTimeStamp, path);
-            m->reset();
-        }
-        m->put(minKey, valForMinKey);
+    std::vector<uint64_t> samples;
+    for (SSTable *st : inputs) {
+        samples.push_back(st->returnHeader()->minKey);
+        st->sampleKeys(SUBCOMPACTION_SAMPLE, samples);
+    }
+    std::sort(samples.begin(), samples.end());
+    samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+    /* Every part starts at a sample after the smallest key, so none is empty by construction */
+    for (uint64_t i = 1; i < parts; ++i) {
+        uint64_t key = samples[samples.size() * i / parts];
+        if (key > samples.front() && (bounds.empty() || key > bounds.back()))
+            bounds.push_back(key);
+    }
+}
 
-        /****** Judge if the loop is to an end *******/
-        if (!KWayBuf.empty()) isContinue = true;
+/**
+ * @brief Write the merged K-V pairs of the compaction inputs with keys in [begin, end] into SSTables of
+ *        at most maxFileBytes, each overlapping about MAX_GRANDPARENT_OVERLAP_FILES SSTables worth of grandparents
+ *        at most.
+ *        Several calls may run at once on disjoint ranges, each with its own input.
+ * @param input Merge of the input SSTables (newest version of every key)
+ * @param timeStamp timeStamp of the output SSTables: the max timeStamp of the inputs
+ * @param level The level that we write SSTable into
+ * @param dropDelete Drop "~DELETE~" symbols that win the combination
+ * @param flushImms Flush a pending imm between output files (only the background thread itself may)
+ * @param maxFileBytes Size an output SSTable may grow to
+ * @param grandparents SSTables of the level below level, sorted by minKey
+ * @param outputs The SSTables written (not added to levels yet)
+ * @return false if an output could not be written; outputs then holds those written before it
+ */
+bool KVStore::kwayCombine(Iterator *input, uint64_t begin, uint64_t end, uint64_t timeStamp, int level,
+                          bool dropDelete, bool flushImms, uint64_t maxFileBytes,
+                          const std::vector<SSTable *> &grandparents, std::vector<SSTable *> &outputs)
+{
+    std::string dirPath = levelPath(level);
+    SSTableBuilder builder(options.bitsPerKey, compressionOf(level), options.blockSize);
+    uint64_t gpIndex = 0;                   //First grandparent that may hold the current key
+    uint64_t overlapBytes = 0;              //Grandparent bytes passed since the current SSTable started
+    uint64_t maxOverlapBytes = MAX_GRANDPARENT_OVERLAP_FILES * options.memTableBytes;
 
+    for (input->seek(begin); input->valid() && input->key() <= end; input->next()) {
+        uint64_t key = input->key();
+        const std::string &val = input->value();
+        if (dropDelete && val == "~DELETE~") continue;
+        while (gpIndex < grandparents.size() && key > grandparents[gpIndex]->returnHeader()->maxKey) {
+            if (!builder.isEmpty()) overlapBytes += grandparents[gpIndex]->fileSize();
+            ++gpIndex;
+        }
+        /* Start a new SSTable if this pair would make the current one outgrow maxFileBytes,
+         * or the current one already spans too much of the next level: a later compaction of it would drag that in */
+        if (!builder.isEmpty() && (builder.sizeAfterAdd(val) > maxFileBytes
+                                   || overlapBytes > maxOverlapBytes)) {
+            std::string path = dirPath + "/" + SSTable::fileName(maxTimeStamp++);
+            SSTable *st = builder.finish(timeStamp, path, cache, options.useMmap);
+            if (st == nullptr) return false;
+            outputs.push_back(st);
+            overlapBytes = 0;
+            /* Do not keep writers waiting for the whole compaction; the new level0 SSTable is newer than every input */
+            if (flushImms && hasImm()) flushImm();
+        }
+        builder.add(key, val);
+    }
+    /* Write the remaining pairs */
+    if (!builder.isEmpty()) {
+        std::string remainPath = dirPath + "/" + SSTable::fileName(maxTimeStamp++);
+        SSTable *st = builder.finish(timeStamp, remainPath, cache, options.useMmap);
+        if (st == nullptr) return false;
+        outputs.push_back(st);
     }
-    /* Write remaining nodes in m(MemTable) to the disk and create cache */
-    std::string remainPath = dirPath + "/sstable" + std::to_string(maxTimeStamp++) + ".sst";
-    m->createSSTable(SSVec, KVTimeStamp, remainPath);
-    /* Deallocating Memory */
-    m->deleteTable();
+    return true;
 }
 
 /**
  * Insert/Update the key-value pair.
- * No return values for simplicity.
+ * No return values for simplicity: a pair that could not be logged is dropped, use tryPut to find out.
  */
 void KVStore::put(uint64_t key, const std::string &s)
 {
-    /* If is to overflow */
-    if (isOverflow(key, s)) {
-        std::string dirPath = dataDir + "/Level0";
-        /* Check if dir exits or not */
-        if (!utils::dirExists(dirPath)) {
-            utils::mkdir(dirPath.c_str());
+    tryPut(key, s);
+}
+
+/**
+ * @brief Insert/Update the key-value pair
+ * @return false if it could not be written to the log; it is not applied then
+ */
+bool KVStore::tryPut(uint64_t key, const std::string &s)
+{
+    if (!isOpen) return false;
+    std::shared_lock<std::shared_timed_mutex> sl = lockMem();
+    /* If is to overflow, hand MemTable to the background thread; the pair goes to the log of the next MemTable */
+    while (!mem->isEmpty() && isOverflow(key, s)) {
+        MemTable *full = mem;
+        sl.unlock();
+        makeRoomForWrite(full);
+        sl = lockMem();
+    }
+    std::string payload;
+    WAL::encodePut(payload, key, s);
+    uint64_t sequence;
+    bool isLogged = wal->addRecord(payload, sequence);
+    if (isLogged) mem->put(key, s, sequence);
+    publish(sequence);
+    return isLogged;
+}
+
+/**
+ * @brief Apply every operation of batch as one write: one log record, so after a crash all of it is
+ *        recovered or none of it, and one sorted pass over the MemTable.
+ *        A batch always goes into a single MemTable, even if it is bigger than options.memTableBytes on its own.
+ *        Atomic for readers too: its pairs share one sequence, which is published once all of them are in,
+ *        so a get, multiGet, scan or iterator sees all of the batch or none of it.
+ * @return false if the batch could not be written to the log; none of it is applied then
+ */
+bool KVStore::write(WriteBatch &batch)
+{
+    if (!isOpen) return false;
+    std::vector<const KVPair *> pairs;
+    batch.sortedEntries(pairs);
+    if (pairs.empty()) return true;
+
+    /* One overflow check for the whole batch, counting every key as new */
+    std::string payload;
+    uint64_t bytes = 0;
+    for (const KVPair *kv : pairs) {
+        bytes += 12 + kv->second.length();
+        WAL::encodePut(payload, kv->first, kv->second);
+    }
+    std::shared_lock<std::shared_timed_mutex> sl = lockMem();
+    while (!mem->isEmpty() && (mem->byteSizeAfter(pairs.size(), bytes) > options.memTableBytes
+                               || mem->memoryUsage() + bytes > MAX_ARENA_FACTOR * options.memTableBytes)) {
+        MemTable *full = mem;
+        sl.unlock();
+        makeRoomForWrite(full);
+        sl = lockMem();
+    }
+
+    uint64_t sequence;
+    bool isLogged = wal->addRecord(payload, sequence);
+    if (isLogged) mem->putSorted(pairs, sequence);
+    publish(sequence);
+    return isLogged;
+}
+
+/**
+ * @brief Share mem and wal with other readers and writers until the returned lock is released.
+ *        Waits while a switch is pending.
+ */
+std::shared_lock<std::shared_timed_mutex> KVStore::lockMem()
+{
+    if (isSwitching) std::lock_guard<std::mutex> wait(switchLock);
+    return std::shared_lock<std::shared_timed_mutex>(memLock);
+}
+
+/**
+ * @brief Hand the full MemTable to the background thread and start a new one with its own log, once every
+ *        write in flight has finished with it. Writes only wait if the previous MemTable is still being flushed.
+ * @param full the MemTable found full; nothing is done if another writer switched it already
+ */
+void KVStore::makeRoomForWrite(MemTable *full)
+{
+    std::lock_guard<std::mutex> turn(switchLock);
+    isSwitching = true;
+    {
+        std::unique_lock<std::shared_timed_mutex> ex(memLock);
+        if (mem == full) {
+            std::unique_lock<std::mutex> lk(mutex);
+            while (imm != nullptr)
+                bgDone.wait(lk);
+            switchMemTable();
+            lk.unlock();
+            bgWork.notify_one();
         }
-        /* Store some parts of sstable in cache and write whole to disk */
-        std::string path = dirPath + "/sstable" + std::to_string(maxTimeStamp) + ".sst";
-        mem->createSSTable(SSVec, maxTimeStamp++, path);
-        /* If files num in level0 > 2, compact SSTables in disk */
-        if (isToCompact()) compact();
-        /* Reset MemTable */
-        mem->reset();
     }
-    mem->put(key, s);
+    isSwitching = false;
+}
+
+/**
+ * @brief Make the writes up to sequence visible to readers, once those before it are. Every sequence the log
+ *        hands out is published, also that of a write that failed, or the later ones would wait forever.
+ *        Called with memLock shared: a switch waits until mem holds only published writes.
+ */
+void KVStore::publish(uint64_t sequence)
+{
+    std::unique_lock<std::mutex> lk(publishLock);
+    while (visibleSequence != sequence - 1)
+        published.wait(lk);
+    visibleSequence = sequence;
+    lk.unlock();
+    published.notify_all();
+}
+
+/**
+ * @brief Insert a pair replayed from a log: same as put, but not logged again
+ * @param sequence position of the pair among the replayed ones
+ */
+void KVStore::applyPut(uint64_t key, const std::string &s, uint64_t sequence)
+{
+    /* Once a flush failed, the rest of the logs is replayed into the same MemTable */
+    if (imm == nullptr && isOverflow(key, s)) {
+        switchMemTable();
+        if (flushImm() && isToCompact()) compact();
+    }
+    mem->put(key, s, sequence);
 }
+
 /**
  * Returns the (string) value of the given key.
- * An empty string indicates not found.
+ * An empty string indicates not found. A key whose block can not be read is not found either (see readErrors):
+ * the search stops there instead of returning an older value.
  */
 std::string KVStore::get(uint64_t key)
 {
-    std::string getMemStr;
-    /* Deleted in mem */
-    if (mem->isDeleted(key)) return "";
-    /* Not found in mem ( not deleted ) */
-    else if ((getMemStr = mem->get(key)) != "") return getMemStr;
-    /* Search it in SSTables */
-    else if (!SSVec.empty()){
-        int size = SSVec.size();
-        std::string retStr = "";
-        uint64_t maxStamp = 0;
-        for (int i = 0; i < size; ++i) {
-            std::string loopStr = SSVec[i]->get(key);
-            uint64_t timeStamp = SSVec[i]->returnHeader()->timeStamp;
-            if (loopStr == "~DELETE~" && timeStamp > maxStamp) {
-                retStr = "";
-                maxStamp = timeStamp;
+    uint64_t sequence = visibleSequence;
+    Version *v = currentVersion();
+    uint64_t probes = 0;
+    bool isCorrupt;
+    std::string val = v->get(key, sequence, probes, isCorrupt);
+    v->unref();
+    ++gets;
+    tablesProbed += probes;
+    if (isCorrupt) ++readErrors;
+    return val == "~DELETE~" ? "" : val;
+}
+/**
+ * @brief get for many keys at once. The keys are sorted once, then every MemTable and SSTable that may hold
+ *        one of them is searched a single time for all of its keys, newest first, like get.
+ *        Adds one to gets per key asked for, and one to tablesProbed per SSTable searched.
+ * @param values set to the value of each of keys ("" if not found), in the same order
+ */
+void KVStore::multiGet(const std::vector<uint64_t> &keys, std::vector<std::string> &values)
+{
+    std::vector<uint64_t> sorted(keys);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    /* pending: keys not decided yet, slots: their index in sorted */
+    std::vector<uint64_t> pending(sorted);
+    std::vector<uint64_t> slots(sorted.size());
+    for (uint64_t i = 0; i < slots.size(); ++i) slots[i] = i;
+    std::vector<std::string> found(sorted.size());
+    std::vector<std::string> vals(sorted.size());
+
+    /* Flushes and compactions go on meanwhile, the Version keeps every source alive */
+    uint64_t unreadable = 0;
+    uint64_t probes = 0;
+    uint64_t sequence = visibleSequence;
+    Version *v = currentVersion();
+    v->mem->getSorted(pending.data(), pending.size(), vals.data(), sequence);
+    resolveKeys(pending, slots, vals, found);
+    if (v->imm != nullptr && !pending.empty()) {
+        v->imm->getSorted(pending.data(), pending.size(), vals.data(), sequence);
+        resolveKeys(pending, slots, vals, found);
+    }
+    for (uint64_t level = 0; level < v->levels.size() && !pending.empty(); ++level) {
+        /* Level0: files may overlap, each one gets every key left */
+        if (level == 0) {
+            for (SSTable *st : v->levels[0]) {
+                ++probes;
+                st->getSorted(pending.data(), pending.size(), vals.data(), unreadable);
+                resolveKeys(pending, slots, vals, found);
+                if (pending.empty()) break;
             }
-            else if (loopStr != "" && timeStamp > maxStamp) {
-                retStr = loopStr;
-                maxStamp = timeStamp;
+            continue;
+        }
+        /* Other levels: the sorted files split the sorted keys into disjoint runs */
+        uint64_t k = 0;
+        for (uint64_t i = 0; i < pending.size(); ++i) vals[i] = "";
+        for (SSTable *st : v->levels[level]) {
+            SSInfo *h = st->returnHeader();
+            while (k < pending.size() && pending[k] < h->minKey) ++k;
+            uint64_t end = k;
+            while (end < pending.size() && pending[end] <= h->maxKey) ++end;
+            if (end > k) {
+                ++probes;
+                st->getSorted(pending.data() + k, end - k, vals.data() + k, unreadable);
             }
+            k = end;
+            if (k == pending.size()) break;
+        }
+        resolveKeys(pending, slots, vals, found);
+    }
+    v->unref();
+    gets += keys.size();
+    tablesProbed += probes;
+    readErrors += unreadable;
+
+    values.resize(keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i)
+        values[i] = found[std::lower_bound(sorted.begin(), sorted.end(), keys[i]) - sorted.begin()];
+}
+
+/**
+ * @brief Record the keys decided by one lookup of multiGet and drop them from the pending ones.
+ * @param vals result of the lookup for each pending key: a value, "~DELETE~", or "" (still undecided)
+ */
+void KVStore::resolveKeys(std::vector<uint64_t> &keys, std::vector<uint64_t> &slots, std::vector<std::string> &vals,
+                          std::vector<std::string> &found)
+{
+    uint64_t left = 0;
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        if (vals[i] == "") {
+            keys[left] = keys[i];
+            slots[left] = slots[i];
+            ++left;
         }
-        return retStr;
+        else if (vals[i] != "~DELETE~") found[slots[i]].swap(vals[i]);
     }
-    return "";
+    keys.resize(left);
+    slots.resize(left);
 }
+
 /**
  * Delete the given key-value pair if it exists.
- * Returns false iff the key is not found.
+ * Returns false if the key is not found, or the deletion could not be written to the log.
  */
 bool KVStore::del(uint64_t key)
 {
-    std::string getStr = mem->get(key);
-    /* Key is deleted in MemTable */
-    if (mem->isDeleted(key))
-        return false;
-    /* Key is found In MemTable */
-    else if (getStr != "")
-        return mem->del(key);
-    /* Search in SSTables */
-    else if (!SSVec.empty()){
-        int size = SSVec.size();
-        for (int i = size - 1; i >= 0; --i) {
-            std::string retStr = SSVec[i]->get(key);
-            if (retStr != "" && retStr != "~DELETE") {
-                put(key, "~DELETE~");
-                return true;
-            }
+    if (!isOpen) return false;
+    {
+        std::shared_lock<std::shared_timed_mutex> sl = lockMem();
+        std::string val;
+        if (mem->find(key, val)) {
+            /* Key is deleted in MemTable */
+            if (val == "~DELETE~") return false;
+            /* Key is found In MemTable */
+            std::string payload;
+            WAL::encodePut(payload, key, "~DELETE~");
+            uint64_t sequence;
+            bool isLogged = wal->addRecord(payload, sequence);
+            if (isLogged) mem->put(key, "~DELETE~", sequence);
+            publish(sequence);
+            return isLogged;
         }
     }
+    /* Search in SSTables: the newest version decides */
+    if (get(key) != "") return tryPut(key, "~DELETE~");
     return false;
 }
 
@@ -475,23 +1160,45 @@ bool KVStore::del(uint64_t key)
  */
 void KVStore::reset()
 {
-    /* Reinitialize MemTable */
-    mem->reset();
+    if (!isOpen) return;
+    /* Keep writers out, then wait until the background thread is idle, and keep it idle */
+    std::lock_guard<std::mutex> turn(switchLock);
+    isSwitching = true;
+    std::unique_lock<std::shared_timed_mutex> ex(memLock);
+    std::unique_lock<std::mutex> lk(mutex);
+    while (isBgActive)
+        bgDone.wait(lk);
+    /* Reinitialize MemTable, an imm not flushed yet goes with it */
+    mem->unref();
+    mem = new MemTable(options.bitsPerKey);
+    if (imm != nullptr) {
+        imm->unref();
+        imm = nullptr;
+    }
+    /* Log the empty version first: a crash below leaves only unreferenced files.
+     * File numbers are not restarted: readers may still hold old tables, whose files go when they let go */
+    newLog();
+    memLogNumber = logNumber;
+    manifest->writeSnapshot(std::vector<FileMeta>(), maxTimeStamp, 0, logNumber);
+    removeLogs(0, logNumber);
     /* Delete cache for SSTables and corresponding files in disk */
-    uint64_t size = SSVec.size();
-    for (uint64_t i = 0; i < size; ++i) {
-        SSVec[i]->reset();
+    int levelNum = (int) levels.size();
+    for (std::vector<SSTable *> &tables : levels) {
+        for (SSTable *st : tables) {
+            st->markObsolete();
+            st->unref();
+        }
     }
-    /* Reset maxTimeStamp */
-    maxTimeStamp = 1;
-    /* Delete the remaining empty directories */
-    int level = 0;
-    while (true) {
-        std::string dirPath = dataDir + "/Level" + std::to_string(level);
+    levels.clear();
+    installVersion();
+    cache->clear();
+    /* Delete the remaining empty directories (levels in between may have none) */
+    for (int level = 0; level < levelNum || utils::dirExists(levelPath(level)); ++level) {
+        std::string dirPath = levelPath(level);
         if (utils::dirExists(dirPath))
             utils::rmdir(dirPath.c_str());
-        else break;
     }
+    isSwitching = false;
 }
 
 /**
@@ -501,72 +1208,95 @@ void KVStore::reset()
  */
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list)
 {
-    /******* Part1: Scan MemTable and the result will be stored in list1 *******/
-    std::list<std::pair<uint64_t, std::string> > list1;
-    mem->scan(key1, key2, list1);
-    if (SSVec.empty()) {list = list1; return; }
-
-    /******* Part2: Scan SSTable and the result will be stored in list2 *******/
-    std::list<std::pair<uint64_t, std::string> > list2;
-
-    /* Initialize some variables and vectors for scan */
-    uint64_t SSVecSize = SSVec.size();
-    MemTable *SSMem = new MemTable;
-    std::vector<int> ScanIndexVec;
-
-    /* Select SSTable that is in the range [key1, key2]. Store their indexes in ScanIndexVec */
-    for (uint64_t i = 0; i < SSVecSize; ++i) {
-        SSInfo *header = SSVec[i]->returnHeader();
-        if (!(header->minKey < key1 && header->maxKey < key1
-        || header->minKey >= key2 && header->maxKey >= key2)) {
-            ScanIndexVec.push_back(i);
+    uint64_t sequence = visibleSequence;
+    Version *v = currentVersion();
+    /* Sources from the newest to the oldest: MemTable, imm, level0 (newest first), then the deeper levels,
+     * each read one file at a time */
+    std::vector<Iterator *> children;
+    children.push_back(new MemTableIterator(v->mem, sequence));
+    if (v->imm != nullptr)
+        children.push_back(new MemTableIterator(v->imm, sequence));
+    for (uint64_t level = 0; level < v->levels.size(); ++level) {
+        std::vector<SSTable *> &tables = v->levels[level];
+        if (level > 0) {
+            if (!tables.empty()) children.push_back(new LevelIterator(tables));
+            continue;
+        }
+        for (SSTable *st : tables) {
+            SSInfo *header = st->returnHeader();
+            if (!(header->maxKey < key1 || header->minKey > key2))
+                children.push_back(new SSTableIterator(st));
         }
     }
 
-    /* Load corresponding SSTable to memory, and write them to SkipList */
-    uint64_t scanSize = ScanIndexVec.size();
-    for (int i = 0 ; i < scanSize; ++i) {
-        KVArray *kv = new KVArray(SSVec[ScanIndexVec[i]], KVReadMode::RMDELETE);
-        int size = kv->cacheSize;
-        for (int j = 0; j < size; ++j) {
-            if (kv->KVCache[j].first < key1) continue;
-            else if (kv->KVCache[j].first > key2) break;
-            else SSMem->put(kv->KVCache[j].first, kv->KVCache[j].second);
-        }
+    /* The merge yields the newest version of every key; drop the deleted ones */
+    MergingIterator *it = new MergingIterator(children);
+    for (it->seek(key1); it->valid() && it->key() <= key2; it->next()) {
+        const std::string &val = it->value();
+        if (val != "~DELETE~")
+            list.push_back(std::pair<uint64_t, std::string>(it->key(), val));
     }
-    SSMem->scan(key1, key2, list2);
+    delete it;
+    v->unref();
+}
 
+/**
+ * @brief Open a cursor over the whole store (deleted keys skipped). It reads the MemTables and SSTables
+ *        of this moment and keeps them alive until it is deleted, which must happen before the store is.
+ * @return The iterator, not positioned yet; the caller deletes it
+ */
+Iterator *KVStore::newIterator()
+{
+    uint64_t sequence = visibleSequence;
+    return new KVIterator(currentVersion(), sequence);
+}
 
-    /********* Part3: Combine list1 and list2 **********/
-    /* Two Way Combine */
-    while (!list1.empty() && !list2.empty()) {
-        std::pair<uint64_t, std::string> node1(list1.front().first, list1.front().second);
-        std::pair<uint64_t, std::string> node2(list2.front().first, list2.front().second);
-        /* key in list1 < key in list2, choose node1 */
-        if (node1.first < node2.first) {
-            list.push_back(std::pair<uint64_t, std::string>(node1.first, node1.second));
-            list1.pop_front();
-        }
-        /* key in list1 = key in list2, choose node1 (because node1 has bigger timestamp) */
-        else if (node1.first == node2.first) {
-            list.push_back(std::pair<uint64_t, std::string>(node1.first, node1.second));
-            list1.pop_front();
-            list2.pop_front();
-        }
-        /* key in list1 > key in list2, choose node2 */
-        else {
-            list.push_back(std::pair<uint64_t, std::string>(node2.first, node2.second));
-            list2.pop_front();
+/**
+ * @brief Fill stats with the counters since the store was opened (by this process: they are not saved)
+ *        and the sizes of the levels now
+ */
+void KVStore::getStats(CompactionStats &stats)
+{
+    stats.bytesFlushed = bytesFlushed;
+    stats.bytesCompacted = bytesCompacted;
+    stats.bytesCompactionRead = bytesCompactionRead;
+    stats.gets = gets;
+    stats.tablesProbed = tablesProbed;
+    stats.readErrors = readErrors;
+    stats.bytesTotal = 0;
+    stats.bytesLastRun = 0;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        for (uint64_t level = 0; level < levels.size(); ++level) {
+            uint64_t bytes = CompactionPolicy::levelBytes(levels[level]);
+            stats.bytesTotal += bytes;
+            /* The oldest run is the deepest non-empty level, or the last level0 file */
+            if (level == 0 && !levels[0].empty()) stats.bytesLastRun = levels[0].back()->fileSize();
+            else if (level > 0 && bytes > 0) stats.bytesLastRun = bytes;
         }
     }
-    /* Add the remaining nodes to list */
-    std::list<std::pair<uint64_t, std::string> > &tmp = (list1.empty()) ? list2 : list1;
-    while (!tmp.empty()) {
-        list.push_back(std::pair<uint64_t, std::string>(tmp.front().first, tmp.front().second));
-        tmp.pop_front();
-    }
+    stats.writeAmplification = (stats.bytesFlushed == 0) ? 0 :
+                               (double) (stats.bytesFlushed + stats.bytesCompacted) / stats.bytesFlushed;
+    stats.readAmplification = (stats.gets == 0) ? 0 : (double) stats.tablesProbed / stats.gets;
+    stats.spaceAmplification = (stats.bytesLastRun == 0) ? 0 : (double) stats.bytesTotal / stats.bytesLastRun;
+}
 
+/**
+ * @param warnings set to what had to be changed about the options the store was opened with, or could not be done
+ *        with them (empty: they were used as given)
+ */
+void KVStore::getOptionWarnings(std::vector<std::string> &warnings)
+{
+    warnings = optionWarnings;
+}
 
+/**
+ * @return false if the MANIFEST was found corrupt. The store then reads as empty and refuses every write,
+ *         and its directory is left as it was, so the MANIFEST can be repaired
+ */
+bool KVStore::isOpened()
+{
+    return isOpen;
 }
 
 /**
@@ -574,6 +1304,12 @@ void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, s
  */
 void KVStore::display()
 {
-    printf("MemTable ByteSize: %d\n", mem->getByteSize());
-    printf("SSTable Num: %lld", SSVec.size());
+    Version *v = currentVersion();
+    printf("MemTable ByteSize: %d\n", v->mem->getByteSize());
+    for (uint64_t level = 0; level < v->levels.size(); ++level)
+        printf("Level%llu SSTable Num: %zu\n", (unsigned long long) level, v->levels[level].size());
+    v->unref();
+    printf("Cache Usage: %llu/%llu, Hits: %llu, Misses: %llu\n",
+           (unsigned long long) cache->getUsage(), (unsigned long long) cache->getCapacity(),
+           (unsigned long long) cache->getHits(), (unsigned long long) cache->getMisses());
 }
\ No newline at end of file
@@ -1,92 +1,225 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+
 #include "kvstore_api.h"
 #include "memtable.h"
 #include "sstable.h"
-
-/**
- * @param NORMALLY Read all K-V pairs
- * @param RMDELETE Read all K-V pairs except for nodes that V = "~DELETE~"
- */
-enum KVReadMode
-{
-    NORMALLY = 1,
-    RMDELETE
-};
-
-struct KVArray {
-    std::vector<std::pair<uint64_t, std::string>> KVCache;     //K-V pairs in SSTable
-    uint64_t cacheSize;                             //The number of K-V pairs
-    uint64_t cachePos;                              //The pos of index (used for sort)
-    uint64_t timeStamp;                             //The timeStamp of cache
-    bool isOverFlow;                                //If cachePos = cacheSize, overflow.
-    KVReadMode mode;                                //The read mode we take
-    KVArray(SSTable *st, KVReadMode _mode) {
-        cacheSize = st->returnHeader()->size;
-        timeStamp = st->returnHeader()->timeStamp;
-        isOverFlow = false;
-        cachePos = 0;
-        mode = _mode;
-        /* Initialize KVCache */
-        std::vector<uint64_t> keyArr;               //Keys in the dic of SSTable
-        st->getDicKey(keyArr);
-        for (int i = 0; i < cacheSize; ++i) {
-            uint64_t key = keyArr[i];
-            std::string val = st->get(key);
-            if (mode == KVReadMode::RMDELETE && val == "~DELETE~") continue;
-            else KVCache.push_back(std::pair<uint64_t, std::string>(key, val));
-        }
-    }
-};
-
-struct KWayNode {
-    uint64_t KWayArrayIndex;
-    uint64_t timeStamp;
-    std::pair<uint64_t, std::string> KVNode;
-    KWayNode(uint64_t _index, uint64_t _stamp, const std::pair<uint64_t, std::string> &_node) {
-        KWayArrayIndex = _index;
-        timeStamp = _stamp;
-        uint64_t key = _node.first;
-        std::string val = _node.second;
-        KVNode = std::pair<uint64_t, std::string>(key, val);
-    }
-};
+#include "sstableiterator.h"
+#include "mergingiterator.h"
+#include "leveliterator.h"
+#include "kviterator.h"
+#include "manifest.h"
+#include "wal.h"
+#include "writebatch.h"
+#include "version.h"
+#include "compactionpolicy.h"
+#include "options.h"
+
+#define MAX_SUBCOMPACTIONS 4                    //Threads one compaction may merge with
+#define SUBCOMPACTION_MIN_FILES 2               //Input each of them gets at least, in SSTables of memTableBytes
+#define SUBCOMPACTION_SAMPLE 64                 //Every SUBCOMPACTION_SAMPLE-th key of an input may be a cut point
+#define MAX_GRANDPARENT_OVERLAP_FILES 10        //SSTables of memTableBytes in the level below its own one output may overlap
+#define MAX_ARENA_FACTOR 4                      //Switch MemTable once it holds this many times memTableBytes of memory
+#define MAX_OPEN_THREADS 8                      //Threads that open the SSTables of a store at startup
+#define OPEN_MIN_TABLES 32                      //SSTables each of them gets at least
+#define BG_RETRY_MS 1000                        //Wait before flushing again an imm that could not be written
 
 class KVStore : public KVStoreAPI {
     // You can add your implementation here
 private:
     MemTable *mem;
 
-    std::vector<SSTable *> SSVec;
+    MemTable *imm;                  //Full MemTable being flushed by the background thread, nullptr if none
+
+    uint64_t immLogNumber;          //Number of the first log that holds pairs of imm
+
+    uint64_t memLogNumber;          //Number of the first log that holds pairs of mem
+
+    /* SSTables of every level. levels[0] is sorted from newest to oldest;
+     * levels[i] (i > 0) is sorted by minKey and its key ranges do not overlap */
+    std::vector<std::vector<SSTable *>> levels;
+
+    BlockCache *cache;
 
-    uint64_t maxTimeStamp;
+    Options options;                //What the store was opened with, saved in "dir/OPTIONS"
+
+    std::vector<std::string> optionWarnings;        //What was changed or could not be done about the options
+
+    std::atomic<uint64_t> maxTimeStamp;     //Next timeStamp, also the next file number
 
     std::string dataDir;
 
+    Manifest *manifest;             //Log of the SSTables that make up every level
+
+    bool isOpen;                    //false if the MANIFEST is corrupt: the store is left empty and read-only
+
+    WAL *wal;                       //Write-ahead log of MemTable, nullptr while recovering
+
+    uint64_t logNumber;             //Number of the log wal writes to
+
+    uint64_t lastSequence;          //Sequence of the last pair replayed, or written to the logs closed so far
+
+    /* Readers see the MemTables as of visibleSequence: every write up to it is wholly applied. Writers publish
+     * their sequences in log order under publishLock, so a batch shows up all at once */
+    std::atomic<uint64_t> visibleSequence;
+
+    std::mutex publishLock;
+
+    std::condition_variable published;      //Signaled when visibleSequence moves
+
+    /* Guards imm, levels and logNumber against the background thread. The background thread is the only one
+     * changing levels, so it reads them without the lock; readers go through current instead */
+    std::mutex mutex;
+
+    Version *current;               //What readers see: mem, imm and levels as of the last change
+
+    std::mutex versionLock;         //Guards current only, held just long enough to ref or swap it
+
+    /* Writers of mem (and wal) share memLock, switching them takes it exclusively. While a switch waits,
+     * isSwitching sends new arrivals to queue on switchLock, so a steady stream of writers can not starve it */
+    std::shared_timed_mutex memLock;
+
+    std::mutex switchLock;
+
+    std::atomic<bool> isSwitching;
+
+    std::condition_variable bgWork;         //Signaled when imm is set or the store is closing
+
+    std::condition_variable bgDone;         //Signaled when imm is flushed or the background thread goes idle
+
+    bool isBgActive;                        //The background thread is flushing or compacting
+
+    bool isClosing;
+
+    std::thread bgThread;
+
+    CompactionPolicy *policy;               //Decides what compact() merges
+
+    /* Amplification counters, see CompactionStats */
+    std::atomic<uint64_t> bytesFlushed;
+
+    std::atomic<uint64_t> bytesCompacted;
+
+    std::atomic<uint64_t> bytesCompactionRead;
+
+    std::atomic<uint64_t> gets;
+
+    std::atomic<uint64_t> tablesProbed;
+
+    std::atomic<uint64_t> readErrors;
+
     bool isOverflow(uint64_t key, const std::string &str);
+
+    std::shared_lock<std::shared_timed_mutex> lockMem();
+
+    void makeRoomForWrite(MemTable *full);
+
+    void publish(uint64_t sequence);
+
+    std::string levelPath(int level);
+
+    CompressionType compressionOf(int level);
+
+    void addTable(int level, SSTable *st);
+
+    void removeTable(int level, SSTable *st);
+
+    FileMeta tableMeta(int level, SSTable *st);
+
+    void openTables(const std::vector<std::string> &paths, std::vector<SSInfo *> &headers,
+                    std::vector<SSTable *> &tables);
+
+    void loadFromDirs();
+
+    void removeObsoleteFiles();
+
+    bool saveManifest();
+
+    bool logEdit(const VersionEdit &edit);
+
+    void removeLogs(uint64_t begin, uint64_t end);
+
+    void switchMemTable();
+
+    void installVersion();
+
+    Version *currentVersion();
+
+    bool flushImm();
+
+    bool hasImm();
+
+    void backgroundWork();
+
+    void newLog();
+
+    void recoverLogs(uint64_t minLogNumber);
+
+    void applyPut(uint64_t key, const std::string &s, uint64_t sequence);
+
+    void resolveKeys(std::vector<uint64_t> &keys, std::vector<uint64_t> &slots, std::vector<std::string> &vals,
+                     std::vector<std::string> &found);
+
+    void checkOptions(const std::string &dir);
+
+    static Options savedOptions(const std::string &dir);
+
+    bool isToCompact();
+
+    void compact();
+
+    bool runCompaction(const CompactionJob &job);
+
+    void pickTrivialMoves(const CompactionJob &job, bool dropDelete, const std::vector<SSTable *> &grandparents,
+                          std::vector<bool> &isMoved);
+
+    void splitCompaction(const std::vector<SSTable *> &inputs, std::vector<uint64_t> &bounds);
+
+    bool kwayCombine(Iterator *input, uint64_t begin, uint64_t end, uint64_t timeStamp, int level, bool dropDelete,
+                     bool flushImms, uint64_t maxFileBytes, const std::vector<SSTable *> &grandparents,
+                     std::vector<SSTable *> &outputs);
+
+    void display();
+
+    /* Tests call the compaction steps above directly */
+    friend class FeatureTest;
 public:
-    KVStore(const std::string &dir);
+    KVStore(const std::string &dir) : KVStore(dir, savedOptions(dir)) {}
+
+    KVStore(const std::string &dir, const Options &_options);
 
     ~KVStore();
 
     void put(uint64_t key, const std::string &s) override;
 
+    bool tryPut(uint64_t key, const std::string &s);
+
     std::string get(uint64_t key) override;
 
+    void multiGet(const std::vector<uint64_t> &keys, std::vector<std::string> &values);
+
     bool del(uint64_t key) override;
 
+    bool write(WriteBatch &batch);
+
     void reset() override;
 
     void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list) override;
 
-    bool isToCompact();
+    Iterator *newIterator();
 
-    void compact();
+    void getStats(CompactionStats &stats);
 
-    void kwayCombine(std::vector<KVArray *> &Arr, const std::string &dirPath);
+    void getOptionWarnings(std::vector<std::string> &warnings);
 
-    void display();
+    bool isOpened();
 };
 
 
@@ -0,0 +1,97 @@
+#include "leveliterator.h"
+
+/**
+ * @brief Put the cursor on tables[i], closing the SSTable it was on. i = tables.size() leaves it invalid.
+ *        An error of the closed SSTable is kept.
+ */
+void LevelIterator::openTable(uint64_t i)
+{
+    if (iter != nullptr && i == index) return;
+    if (iter != nullptr && iter->hasError()) isCorrupt = true;
+    delete iter;
+    iter = nullptr;
+    index = i;
+    if (index < tables.size()) iter = new SSTableIterator(tables[index]);
+}
+
+/**
+ * @brief Past the end of an SSTable, go on with the first pair of the next one
+ */
+void LevelIterator::skipEmptyForward()
+{
+    while (iter != nullptr && !iter->valid()) {
+        openTable(index + 1);
+        if (iter != nullptr) iter->seekToFirst();
+    }
+}
+
+/**
+ * @brief Before the start of an SSTable, go on with the last pair of the one before
+ */
+void LevelIterator::skipEmptyBackward()
+{
+    while (iter != nullptr && !iter->valid()) {
+        openTable(index == 0 ? tables.size() : index - 1);
+        if (iter != nullptr) iter->seekToLast();
+    }
+}
+
+void LevelIterator::seekToFirst()
+{
+    openTable(0);
+    if (iter != nullptr) iter->seekToFirst();
+    skipEmptyForward();
+}
+
+void LevelIterator::seekToLast()
+{
+    openTable(tables.empty() ? 0 : tables.size() - 1);
+    if (iter != nullptr) iter->seekToLast();
+    skipEmptyBackward();
+}
+
+/**
+ * @brief Move to the first K-V pair whose key >= key: it is in the first SSTable whose maxKey >= key
+ */
+void LevelIterator::seek(uint64_t key)
+{
+    uint64_t left = 0;
+    uint64_t right = tables.size();
+    while (left < right) {
+        uint64_t mid = (left + right) / 2;
+        if (tables[mid]->returnHeader()->maxKey < key) left = mid + 1;
+        else right = mid;
+    }
+    openTable(left);
+    if (iter != nullptr) iter->seek(key);
+    skipEmptyForward();
+}
+
+/**
+ * @brief Move to the last K-V pair whose key <= key: it is in the last SSTable whose minKey <= key
+ */
+void LevelIterator::seekForPrev(uint64_t key)
+{
+    uint64_t left = 0;
+    uint64_t right = tables.size();
+    while (left < right) {
+        uint64_t mid = (left + right) / 2;
+        if (tables[mid]->returnHeader()->minKey <= key) left = mid + 1;
+        else right = mid;
+    }
+    openTable(left == 0 ? tables.size() : left - 1);
+    if (iter != nullptr) iter->seekForPrev(key);
+    skipEmptyBackward();
+}
+
+void LevelIterator::next()
+{
+    iter->next();
+    skipEmptyForward();
+}
+
+void LevelIterator::prev()
+{
+    iter->prev();
+    skipEmptyBackward();
+}
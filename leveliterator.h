@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "sstable.h"
+#include "sstableiterator.h"
+
+/**
+ * Cursor over one level below level0. Its SSTables hold disjoint key ranges and are sorted by minKey,
+ * so they are read one after the other: only the SSTable under the cursor has an SSTableIterator
+ * (and with it a read buffer and an open file), however many the level holds.
+ * The SSTables must outlive the iterator.
+ */
+class LevelIterator : public Iterator
+{
+private:
+    std::vector<SSTable *> tables;
+    uint64_t index;                 //SSTable under the cursor, tables.size() if none
+    SSTableIterator *iter;          //Over tables[index], nullptr if none
+    bool isCorrupt;                 //An SSTable closed before reported an error
+
+    void openTable(uint64_t i);
+
+    void skipEmptyForward();
+
+    void skipEmptyBackward();
+
+public:
+    LevelIterator(const std::vector<SSTable *> &_tables) : tables(_tables), index(_tables.size()), iter(nullptr),
+                                                        isCorrupt(false) {}
+
+    ~LevelIterator(){delete iter;}
+
+    bool valid() override {return iter != nullptr && iter->valid();}
+
+    void seekToFirst() override;
+
+    void seekToLast() override;
+
+    void seek(uint64_t key) override;
+
+    void seekForPrev(uint64_t key) override;
+
+    void next() override;
+
+    void prev() override;
+
+    uint64_t key() override {return iter->key();}
+
+    const std::string &value() override {return iter->value();}
+
+    bool hasError() override {return isCorrupt || (iter != nullptr && iter->hasError());}
+};
@@ -0,0 +1,214 @@
+#include <map>
+
+#include "manifest.h"
+#include "coding.h"
+#include "utils.h"
+
+/* Field tags of an encoded VersionEdit */
+enum EditTag
+{
+    ADD_FILE = 1,
+    DEL_FILE,
+    NEXT_TIMESTAMP,
+    LEVEL_NUM,
+    LOG_NUMBER
+};
+
+void VersionEdit::encode(std::string &dst) const
+{
+    for (const FileMeta &meta : addFiles) {
+        coding::putVarint64(dst, ADD_FILE);
+        coding::putVarint64(dst, meta.level);
+        coding::putVarint64(dst, meta.number);
+        coding::putVarint64(dst, meta.timeStamp);
+        coding::putVarint64(dst, meta.size);
+        coding::putVarint64(dst, meta.minKey);
+        coding::putVarint64(dst, meta.maxKey);
+    }
+    for (const std::pair<int, uint64_t> &del : delFiles) {
+        coding::putVarint64(dst, DEL_FILE);
+        coding::putVarint64(dst, del.first);
+        coding::putVarint64(dst, del.second);
+    }
+    if (hasNextTimeStamp) {
+        coding::putVarint64(dst, NEXT_TIMESTAMP);
+        coding::putVarint64(dst, nextTimeStamp);
+    }
+    if (hasLevelNum) {
+        coding::putVarint64(dst, LEVEL_NUM);
+        coding::putVarint64(dst, levelNum);
+    }
+    if (hasLogNumber) {
+        coding::putVarint64(dst, LOG_NUMBER);
+        coding::putVarint64(dst, logNumber);
+    }
+}
+
+/**
+ * @return false if src is not a well-formed edit.
+ */
+bool VersionEdit::decode(const std::string &src)
+{
+    const char *p = src.data();
+    const char *limit = p + src.size();
+    uint64_t tag, level, number;
+    while (p < limit) {
+        if (!coding::getVarint64(p, limit, tag)) return false;
+        switch (tag) {
+            case ADD_FILE: {
+                FileMeta meta;
+                if (!coding::getVarint64(p, limit, level) || !coding::getVarint64(p, limit, meta.number)
+                    || !coding::getVarint64(p, limit, meta.timeStamp) || !coding::getVarint64(p, limit, meta.size)
+                    || !coding::getVarint64(p, limit, meta.minKey) || !coding::getVarint64(p, limit, meta.maxKey))
+                    return false;
+                meta.level = (int) level;
+                addFiles.push_back(meta);
+                break;
+            }
+            case DEL_FILE:
+                if (!coding::getVarint64(p, limit, level) || !coding::getVarint64(p, limit, number))
+                    return false;
+                delFile((int) level, number);
+                break;
+            case NEXT_TIMESTAMP:
+                if (!coding::getVarint64(p, limit, nextTimeStamp)) return false;
+                hasNextTimeStamp = true;
+                break;
+            case LEVEL_NUM:
+                if (!coding::getVarint64(p, limit, number)) return false;
+                setLevelNum((int) number);
+                break;
+            case LOG_NUMBER:
+                if (!coding::getVarint64(p, limit, logNumber)) return false;
+                hasLogNumber = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Frame an edit as one MANIFEST record.
+ */
+static void encodeRecord(const VersionEdit &edit, std::string &record)
+{
+    std::string payload;
+    edit.encode(payload);
+    coding::putFixed32(record, coding::crc32(payload.data(), payload.size()));
+    coding::putFixed32(record, (uint32_t) payload.size());
+    record += payload;
+}
+
+Manifest::Manifest(const std::string &_dir) : dir(_dir), fd(-1) {}
+
+Manifest::~Manifest()
+{
+    if (fd >= 0) utils::closeFile(fd);
+}
+
+bool Manifest::exists()
+{
+    return utils::fileExists(dir + "/" + MANIFEST_NAME);
+}
+
+/**
+ * @brief Replay every complete edit of the MANIFEST. Only the last record may be bad: an append cut short
+ *        by a crash. The first record is a snapshot written whole (see writeSnapshot), so it never is.
+ * @param files set to the live SSTables
+ * @param nextTimeStamp set to the last logged timeStamp counter
+ * @param levelNum set to the last logged number of levels
+ * @param logNumber set to the oldest write-ahead log that is not in SSTables yet
+ * @return false if the MANIFEST can not be read or is corrupt: files then misses live SSTables.
+ */
+bool Manifest::recover(std::vector<FileMeta> &files, uint64_t &nextTimeStamp, int &levelNum, uint64_t &logNumber)
+{
+    std::string content;
+    if (utils::readFile((dir + "/" + MANIFEST_NAME).c_str(), content) != 0) return false;
+
+    std::map<std::pair<int, uint64_t>, FileMeta> live;
+    nextTimeStamp = 1;
+    levelNum = 0;
+    logNumber = 0;
+    uint64_t pos = 0;
+    while (pos < content.size()) {
+        /* A torn record at the tail: the edit never happened */
+        if (pos + 8 > content.size()) break;
+        uint32_t crc = coding::decodeFixed32(content.data() + pos);
+        uint32_t len = coding::decodeFixed32(content.data() + pos + 4);
+        if (pos + 8 + len > content.size()) break;
+        std::string payload = content.substr(pos + 8, len);
+        VersionEdit edit;
+        if (coding::crc32(payload.data(), payload.size()) != crc || !edit.decode(payload)) {
+            /* A bad record with more behind it is damage, not a torn append */
+            if (pos + 8 + len < content.size()) return false;
+            break;
+        }
+        for (const std::pair<int, uint64_t> &del : edit.delFiles)
+            live.erase(del);
+        for (const FileMeta &meta : edit.addFiles)
+            live[std::pair<int, uint64_t>(meta.level, meta.number)] = meta;
+        if (edit.hasNextTimeStamp) nextTimeStamp = edit.nextTimeStamp;
+        if (edit.hasLevelNum) levelNum = edit.levelNum;
+        if (edit.hasLogNumber) logNumber = edit.logNumber;
+        pos += 8 + len;
+    }
+    /* Not even the snapshot the MANIFEST starts with */
+    if (pos == 0) return false;
+
+    files.clear();
+    for (auto &it : live)
+        files.push_back(it.second);
+    return true;
+}
+
+/**
+ * @brief Replace the MANIFEST with a single edit describing the current version
+ *        (written to a temporary file and renamed, so a crash keeps either the old or the new one).
+ *        Later edits are appended to the new MANIFEST.
+ * @return true if the new MANIFEST is in place.
+ */
+bool Manifest::writeSnapshot(const std::vector<FileMeta> &files, uint64_t nextTimeStamp, int levelNum, uint64_t logNumber)
+{
+    VersionEdit edit;
+    for (const FileMeta &meta : files)
+        edit.addFile(meta);
+    edit.setNextTimeStamp(nextTimeStamp);
+    edit.setLevelNum(levelNum);
+    edit.setLogNumber(logNumber);
+
+    std::string path = dir + "/" + MANIFEST_NAME;
+    std::string tmpPath = path + ".tmp";
+    int tmpFd = utils::openAppend(tmpPath.c_str(), true);
+    if (tmpFd < 0) return false;
+    std::string record;
+    encodeRecord(edit, record);
+    bool ok = utils::writeAll(tmpFd, record.data(), record.size()) == 0 && utils::syncFile(tmpFd) == 0;
+    utils::closeFile(tmpFd);
+    if (!ok || utils::renameFile(tmpPath.c_str(), path.c_str()) != 0) return false;
+
+    /* The old file is gone; edits are appended to the new one only once its rename is on disk */
+    if (fd >= 0) utils::closeFile(fd);
+    fd = -1;
+    if (utils::syncDir(dir.c_str()) != 0) return false;
+    fd = utils::openAppend(path.c_str());
+    return fd >= 0;
+}
+
+/**
+ * @brief Append one edit and sync it to disk.
+ *        On failure the file may end in part of the record, and an edit appended behind that would never be
+ *        recovered: nothing more is appended until writeSnapshot starts a new MANIFEST.
+ * @return true if the edit is durable.
+ */
+bool Manifest::logEdit(const VersionEdit &edit)
+{
+    if (fd < 0) return false;
+    std::string record;
+    encodeRecord(edit, record);
+    if (utils::writeAll(fd, record.data(), record.size()) == 0 && utils::syncFile(fd) == 0) return true;
+    utils::closeFile(fd);
+    fd = -1;
+    return false;
+}
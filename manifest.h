@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define MANIFEST_NAME "MANIFEST"
+
+/**
+ * What the MANIFEST records about one SSTable.
+ * The file itself is "Level<level>/sstable<number>.sst".
+ */
+struct FileMeta
+{
+    int level;
+    uint64_t number;
+    uint64_t timeStamp;
+    uint64_t size;                  //The number of K-V pairs
+    uint64_t minKey;
+    uint64_t maxKey;
+    FileMeta() : level(0), number(0), timeStamp(0), size(0), minKey(0), maxKey(0) {}
+    FileMeta(int _level, uint64_t _number, uint64_t t, uint64_t s, uint64_t _min, uint64_t _max)
+            : level(_level), number(_number), timeStamp(t), size(s), minKey(_min), maxKey(_max) {}
+};
+
+/**
+ * One atomic change of the set of SSTables: files added and removed,
+ * plus the counters that have to survive a restart.
+ */
+struct VersionEdit
+{
+    std::vector<FileMeta> addFiles;
+    std::vector<std::pair<int, uint64_t>> delFiles;         //(level, number)
+    bool hasNextTimeStamp = false;
+    uint64_t nextTimeStamp = 0;
+    bool hasLevelNum = false;
+    int levelNum = 0;
+    bool hasLogNumber = false;
+    uint64_t logNumber = 0;                                 //Logs older than this are already in SSTables
+
+    void addFile(const FileMeta &meta){addFiles.push_back(meta);}
+
+    void delFile(int level, uint64_t number){delFiles.push_back(std::pair<int, uint64_t>(level, number));}
+
+    void setNextTimeStamp(uint64_t t){hasNextTimeStamp = true; nextTimeStamp = t;}
+
+    void setLevelNum(int n){hasLevelNum = true; levelNum = n;}
+
+    void setLogNumber(uint64_t n){hasLogNumber = true; logNumber = n;}
+
+    void encode(std::string &dst) const;
+
+    bool decode(const std::string &src);
+};
+
+/**
+ * Append-only log of VersionEdits in "dir/MANIFEST".
+ * Record: [crc32(4)][length(4)][encoded VersionEdit]. An edit is applied on recovery only if its
+ * whole record made it to disk, so a crash in the middle of a flush or compaction leaves
+ * the version that was logged before it.
+ */
+class Manifest
+{
+private:
+    std::string dir;
+    int fd;
+
+public:
+    Manifest(const std::string &_dir);
+
+    ~Manifest();
+
+    bool exists();
+
+    bool recover(std::vector<FileMeta> &files, uint64_t &nextTimeStamp, int &levelNum, uint64_t &logNumber);
+
+    bool writeSnapshot(const std::vector<FileMeta> &files, uint64_t nextTimeStamp, int levelNum, uint64_t logNumber);
+
+    bool logEdit(const VersionEdit &edit);
+};
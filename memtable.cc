@@ -1,14 +1,20 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cstddef>
+#include <new>
 #include "memtable.h"
+#include "sstablebuilder.h"
 
 /**
- * @brief Used to generate random number
+ * @brief Used to generate random number. Each writer thread draws from its own sequence.
  * @return Random number
  */
 double MemTable::my_rand()
 {
+    static std::atomic<unsigned long long> seeds(1);
+    thread_local unsigned long long s = 0;
+    if (s == 0) s = (seeds.fetch_add(1) * 48271ULL) % 2147483647ULL + 1;
     s = (16807 * s) % 2147483647ULL;
     return (s + 0.0) / 2147483647ULL;
 }
@@ -27,100 +33,210 @@ int MemTable::randomLevel()
     return result;
 }
 
+/**
+ * @brief Allocate a node with a tower of height pointers and its value in the arena, in one piece.
+ */
+MemNode *MemTable::newNode(uint64_t key, const std::string &val, uint64_t sequence, MemNodeType type, int height)
+{
+    size_t nodeSize = sizeof(MemNode) + sizeof(std::atomic<MemNode *>) * (height - 1);
+    size_t valueSize = (offsetof(MemValue, data) + val.size() + 7) & ~(size_t) 7;
+    char *mem = arena->allocateAligned(nodeSize + valueSize);
+    MemNode *node = reinterpret_cast<MemNode *>(mem);
+    MemValue *v = reinterpret_cast<MemValue *>(mem + nodeSize);
+    v->sequence = sequence;
+    new (&v->older) std::atomic<MemValue *>(nullptr);
+    v->len = (uint32_t) val.size();
+    memcpy(v->data, val.data(), val.size());
+    node->key = key;
+    new (&node->val) std::atomic<MemValue *>(v);
+    node->type = type;
+    node->height = height;
+    for (int i = 0; i < height; ++i)
+        new (&node->forwards[i]) std::atomic<MemNode *>(nullptr);
+    return node;
+}
+
+/**
+ * @brief Allocate a value for an existing node in the arena
+ */
+MemValue *MemTable::newValue(const std::string &val, uint64_t sequence)
+{
+    char *mem = arena->allocateAligned(offsetof(MemValue, data) + val.size());
+    MemValue *v = reinterpret_cast<MemValue *>(mem);
+    v->sequence = sequence;
+    new (&v->older) std::atomic<MemValue *>(nullptr);
+    v->len = (uint32_t) val.size();
+    memcpy(v->data, val.data(), val.size());
+    return v;
+}
+
+/**
+ * @brief Add val to the values of node, in sequence order: it becomes the value of node unless node already
+ *        holds a later write, then it goes behind the later ones. Values are never unlinked, so a failed
+ *        compare-and-swap resumes from the same link.
+ */
+void MemTable::setValue(MemNode *node, MemValue *val)
+{
+    std::atomic<MemValue *> *link = &node->val;
+    MemValue *next = link->load(std::memory_order_acquire);
+    while (true) {
+        while (next != nullptr && next->sequence > val->sequence) {
+            link = &next->older;
+            next = link->load(std::memory_order_acquire);
+        }
+        val->older.store(next, std::memory_order_relaxed);
+        if (link->compare_exchange_weak(next, val, std::memory_order_acq_rel)) break;
+    }
+    if (link == &node->val) byteSize += (int) val->len - (int) next->len;
+}
+
+/**
+ * @brief Start empty: a new arena holding only head and tail
+ */
+void MemTable::init()
+{
+    byteSize = 32;
+    NumOfMemNode = 0;
+    minKey = UINT64_MAX;
+    maxKey = 0;
+    arena = new Arena();
+    head = newNode(0, "", 0, MemNodeType::HEAD, MAX_LEVEL);
+    tail = newNode(UINT64_MAX, "", 0, MemNodeType::NIL, MAX_LEVEL);
+    for (int i = 0; i < MAX_LEVEL; ++i)
+        head->forwards[i].store(tail, std::memory_order_relaxed);
+}
+
 /**
  * @brief Generate cache for SSTable and write the whole SSTable into disk.
- * @param SSVec Cache for SSTable(Organized in array)
  * @param timeStamp The time stamp that will be added to SSTable's header.
+ * @param cache Value cache the new SSTable reads through
+ * @param useMmap Map the new file once it is written
+ * @param compression Codec of its data blocks
+ * @param blockSize Bytes of its data blocks
+ * @return Cache for the new SSTable, nullptr if the file could not be written
  */
-void MemTable::createSSTable(std::vector<SSTable *> &SSVec, uint64_t timeStamp, const std::string &filePath)
-{
-     /* Initialize some variables used for generating cache and SSTable */
-    uint32_t offset = 10240 + 32 + 12 * NumOfMemNode;
-    SSInfo *header = new SSInfo(timeStamp, NumOfMemNode, minKey, maxKey);
-    BloomFilter *bf = new BloomFilter;
-    std::vector<std::pair<uint64_t, uint32_t>> dic;
-    std::string file_path;
-
-    /* Generate bloomfilter and dictionary part of SSTable */
-    MemNode *p = head->forwards[0];
-    while(p->type != MemNodeType::NIL) {
-        uint64_t key = p->key;
-        bf->insert(key);
-        dic.push_back(std::pair<uint64_t, uint32_t>(key, offset));
-        offset += p->val.length();
-        p = p->forwards[0];
-    }
-    /* Generate path for SSTable to store in (level0 at beginning) */
-    file_path = filePath;
-    /* Initialize cache for SSTable */
-    SSTable *st = new SSTable(header, bf, dic, file_path);
-    SSVec.push_back(st);
-
-    /* Write SSTable to disk */
-    std::ofstream in;
-    in.open(file_path, std::ios::out | std::ios::binary);
-    in.write((char *)header, 32);
-    char *tmp = bf->returnData();
-    in.write(tmp, CAPACITY);
-    delete[] tmp;
-    /* Dictionary part */
-    int dicSize = dic.size();
-    for (int i = 0; i < dicSize; ++i) {
-        in.write((char *) &dic[i].first, 8);
-        in.write((char *) &dic[i].second, 4);
-    }
-    /* Value part */
-    MemNode *q = head->forwards[0];
-    uint64_t totalLength = 0;
-    char *buf = new char[2100000];
-    while (q->type != MemNodeType::NIL) {
-        uint64_t length = q->val.length();
-        strcat(buf, q->val.c_str());
-        totalLength += length;
-        q = q->forwards[0];
+SSTable *MemTable::createSSTable(uint64_t timeStamp, const std::string &filePath, BlockCache *cache,
+                                 bool useMmap, CompressionType compression, uint64_t blockSize)
+{
+    SSTableBuilder builder(bitsPerKey, compression, blockSize);
+    MemNode *p = head->next(0);
+    while (p->type != MemNodeType::NIL) {
+        MemValue *v = p->load();
+        builder.addRef(p->key, v->data, v->len);
+        p = p->next(0);
     }
-    in.write(buf, totalLength);
-    delete[] buf;
+    return builder.finish(timeStamp, filePath, cache, useMmap);
+}
+
+/**
+ * @brief Size of the SSTable this MemTable would be written as, with room in the filter for one more key.
+ *        (So adding 12 + val.length() for a new key gives the exact size after inserting it.)
+ * @return size in bytes
+ */
+int MemTable::getByteSize()
+{
+    return byteSize + BloomFilter::sectionSize(NumOfMemNode + 1, bitsPerKey);
+}
+
+/**
+ * @brief Size of the SSTable this MemTable would be written as after adding newKeys keys with newBytes
+ *        bytes of dictionary entries and values.
+ */
+uint64_t MemTable::byteSizeAfter(uint64_t newKeys, uint64_t newBytes)
+{
+    return byteSize + newBytes + BloomFilter::sectionSize(NumOfMemNode + newKeys, bitsPerKey);
 }
 
 /**
- * @brief Add <key, val> to MemTable.
+ * @brief Add <key, val> to MemTable. Safe to call from many threads at once.
  * @param key uint64_t type.
  * @param val std::string type.
+ * @param sequence order of the write in the log; if the key already holds a later write, val is dropped.
  */
-void MemTable::put(uint64_t key, const std::string &val)
+void MemTable::put(uint64_t key, const std::string &val, uint64_t sequence)
 {
+    MemNode *preds[MAX_LEVEL];
+    for (int i = 0; i < MAX_LEVEL; ++i) preds[i] = head;
+    insert(key, val, sequence, preds);
+}
 
-    MemNode *p = head;
-    MemNode *update[MAX_LEVEL];
-    for (int i = 0; i < MAX_LEVEL; ++i) update[i] = NULL;
+/**
+ * @brief Add K-V pairs in ascending key order with one pass over the list: the search for every key starts
+ *        from the path of the previous one (finger search) instead of from head.
+ * @param pairs sorted by key, no duplicates
+ * @param sequence order of the writes in the log, shared by all pairs
+ */
+void MemTable::putSorted(const std::vector<const std::pair<uint64_t, std::string> *> &pairs, uint64_t sequence)
+{
+    MemNode *preds[MAX_LEVEL];
+    for (int i = 0; i < MAX_LEVEL; ++i) preds[i] = head;
+    for (const std::pair<uint64_t, std::string> *kv : pairs)
+        insert(kv->first, kv->second, sequence, preds);
+}
 
-    /* record the path */
+/**
+ * @brief Insert key or update its value. The new node is linked from level 0 up, each level with one
+ *        compare-and-swap on its predecessor; when another writer got there first, the search resumes from
+ *        the predecessor, since nodes are never unlinked.
+ * @param preds on entry, nodes before key on each level to start the search from (head or the path of a smaller
+ *        key); on return, nodes before any bigger key
+ * @return true if key is new
+ */
+bool MemTable::insert(uint64_t key, const std::string &val, uint64_t sequence, MemNode **preds)
+{
+    MemNode *succs[MAX_LEVEL];
+    MemNode *p = head;
     for (int i = MAX_LEVEL - 1; i >= 0; --i) {
-        while (p->forwards[i]->key < key)
-            p = p->forwards[i];
-        update[i] = p;
+        /* preds[i] precedes key at level i; the path from above may already be further along */
+        if (preds[i] != head && (p == head || preds[i]->key > p->key)) p = preds[i];
+        /* Read every link once: a node linked in between two reads may be smaller than key */
+        MemNode *next = p->next(i);
+        while (next->key < key) {
+            p = next;
+            next = p->next(i);
+        }
+        preds[i] = p;
+        succs[i] = next;
     }
-    p = p->forwards[0];
 
-    /* same value, change the val */
-    if (p->key == key && p->val != val) {
-        byteSize += val.length() - p->val.length();     //update byteSize
-        p->val = val;
+    /* same key, change the val */
+    if (succs[0]->key == key && succs[0]->type != MemNodeType::NIL) {
+        setValue(succs[0], newValue(val, sequence));
+        return false;
     }
-    /* different value, insert the node */
-    else {
-        int level = randomLevel();
-        MemNode *newNode = new MemNode(key, val, MemNodeType::NORMAL);
-        for (int i = 0; i < level; ++i) {
-            newNode->forwards[i] = update[i]->forwards[i];
-            update[i]->forwards[i] = newNode;
+
+    int level = randomLevel();
+    MemNode *node = newNode(key, val, sequence, MemNodeType::NORMAL, level);
+    for (int i = 0; i < level; ++i) {
+        while (true) {
+            node->forwards[i].store(succs[i], std::memory_order_relaxed);
+            if (preds[i]->forwards[i].compare_exchange_strong(succs[i], node, std::memory_order_release)) break;
+            /* Another node was linked behind preds[i]: move forward past it */
+            p = preds[i];
+            MemNode *next = p->next(i);
+            while (next->key < key) {
+                p = next;
+                next = p->next(i);
+            }
+            preds[i] = p;
+            succs[i] = next;
+            /* The same key was inserted first: update it instead, node stays unlinked in the arena */
+            if (i == 0 && succs[0]->key == key && succs[0]->type != MemNodeType::NIL) {
+                setValue(succs[0], node->load());
+                return false;
+            }
         }
-        minKey = key < minKey ? key : minKey;           //update minKey
-        maxKey = key > maxKey ? key : maxKey;           //update maxKey
-        byteSize += 12 + val.length();                  //update bytesize
-        NumOfMemNode++;                                 //update NumOfMemNode
+        /* node precedes every bigger key on the levels it is linked into */
+        preds[i] = node;
     }
+
+    uint64_t k = minKey;
+    while (key < k && !minKey.compare_exchange_weak(k, key));
+    k = maxKey;
+    while (key > k && !maxKey.compare_exchange_weak(k, key));
+    byteSize += 12 + val.length();                  //update bytesize
+    NumOfMemNode++;                                 //update NumOfMemNode
+    return true;
 }
 
 /**
@@ -130,123 +246,187 @@ void MemTable::put(uint64_t key, const std::string &val)
  */
 std::string MemTable::get(uint64_t key)
 {
-    MemNode *p = head;
-    for (int i = MAX_LEVEL - 1; i >= 0; --i) {
-        while (p->forwards[i]->key < key) {
-            p = p->forwards[i];
-        }
-    }
-
-    /* If found in MemTable and the node has not been deleted */
-    if (p->forwards[0]->key == key && p->forwards[0]->val != "~DELETE~") {
-        return p->forwards[0]->val;
-    }
-    /* Else return false */
-    else return "";
+    std::string val;
+    if (find(key, val) && val != "~DELETE~") return val;
+    return "";
 }
 
 /**
- * @brief delete node of which key is @param key
- * @param key uint64_t type
- * @return True: if the node exists in MemTable. False: Not Found or has been deleted.
+ * @brief Look up key with one search, telling a deletion apart from a miss.
+ * @param val set to the value of key, "~DELETE~" if deleted
+ * @param sequence only the writes up to this one are seen
+ * @return true if key is in MemTable
  */
-bool MemTable::del(uint64_t key)
+bool MemTable::find(uint64_t key, std::string &val, uint64_t sequence)
 {
     MemNode *p = head;
+    MemNode *next = head;
     for (int i = MAX_LEVEL - 1; i >= 0; --i) {
-        while (p->forwards[i]->key < key) {
-            p = p->forwards[i];
+        next = p->next(i);
+        while (next->key < key) {
+            p = next;
+            next = p->next(i);
         }
     }
-    p = p->forwards[0];
+    p = next;
+    if (p->key != key || p->type == MemNodeType::NIL) return false;
+    MemValue *v = p->load(sequence);
+    if (v == nullptr) return false;
+    val.assign(v->data, v->len);
+    return true;
+}
+
+/**
+ * @brief Look up ascending keys with one pass over the list, each search starting from where the previous
+ *        one stopped.
+ * @param vals set to the value of each key, "~DELETE~" if deleted here, "" if not in MemTable
+ * @param sequence only the writes up to this one are seen
+ */
+void MemTable::getSorted(const uint64_t *keys, uint64_t num, std::string *vals, uint64_t sequence)
+{
+    MemNode *finger[MAX_LEVEL];
+    for (int i = 0; i < MAX_LEVEL; ++i) finger[i] = head;
 
-    /* The node having key @param key is found and has not been deleted */
-    if (p->key == key && p->val != "~DELETE~") {
-        byteSize += 8 - p->val.length();            //update byteSize
-        p->val = "~DELETE~";
-        return true;
+    for (uint64_t k = 0; k < num; ++k) {
+        MemNode *p = head;
+        MemNode *next = head;
+        for (int i = MAX_LEVEL - 1; i >= 0; --i) {
+            if (finger[i] != head && (p == head || finger[i]->key > p->key)) p = finger[i];
+            next = p->next(i);
+            while (next->key < keys[k]) {
+                p = next;
+                next = p->next(i);
+            }
+            finger[i] = p;
+        }
+        p = next;
+        MemValue *v = (p->key == keys[k] && p->type != MemNodeType::NIL) ? p->load(sequence) : nullptr;
+        if (v != nullptr) vals[k].assign(v->data, v->len);
+        else vals[k] = "";
     }
-    /* Else return false */
-    else return false;
 }
 
 /**
- * @brief ReInitialize the MemTable
+ * @brief Drop one reference, the last one frees the MemTable
  */
-void MemTable::reset()
+void MemTable::unref()
 {
-    /* Make MemTable empty */
+    if (--refs > 0) return;
     deleteTable();
+    delete this;
+}
 
-    /* Rebuild MemTable */
-    byteSize = 10240 + 32;
-    NumOfMemNode = 0;
-    minKey = UINT64_MAX;
-    maxKey = 0;
-    head = new MemNode(0, "", MemNodeType::HEAD);
-    tail = new MemNode(UINT64_MAX, "", MemNodeType::NIL);
-    for (int i = 0; i < MAX_LEVEL; ++i)
-        head->forwards[i] = tail;
+/**
+ * @brief Delete the MemTable and release its memory space
+ */
+void MemTable::deleteTable()
+{
+    /* Every node lives in the arena: free them all at once */
+    delete arena;
+    arena = nullptr;
+    head = tail = nullptr;
+}
+
+/**
+ * @brief Move forward past the nodes with no value as of sequence
+ */
+void MemTableIterator::skipForward()
+{
+    while (node->type != MemNodeType::NIL && node->load(sequence) == nullptr)
+        node = node->next(0);
 }
 
 /**
-* Return a list including all the key-value pair between key1 and key2.
-* keys in the list should be in an ascending order.
-* An empty string indicates not found.
- * @param key1 lower bound of keys to search
- * @param key2 upper bound of keys to search
- * @param list the array for key-value pairs
-*/
-void MemTable::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list)
+ * @brief Move backward past the nodes with no value as of sequence
+ */
+void MemTableIterator::skipBackward()
 {
-    MemNode *p = head;
-    list.clear();
+    while (node->type != MemNodeType::NIL && node->load(sequence) == nullptr)
+        seekBefore(node->key);
+}
+
+void MemTableIterator::seekToFirst()
+{
+    node = table->head->next(0);
+    skipForward();
+}
+
+void MemTableIterator::next()
+{
+    node = node->next(0);
+    skipForward();
+}
+
+/**
+ * @brief Move to the first node whose key >= key. O(logn)
+ */
+void MemTableIterator::seek(uint64_t key)
+{
+    MemNode *p = table->head;
+    MemNode *next = p;
     for (int i = MAX_LEVEL - 1; i >= 0; --i) {
-        while (p->forwards[i]->key < key1)
-            p = p->forwards[i];
+        next = p->next(i);
+        while (next->type != MemNodeType::NIL && next->key < key) {
+            p = next;
+            next = p->next(i);
+        }
     }
-    p = p->forwards[0];
+    node = next;
+    skipForward();
+}
 
-    while (p->key <= key2) {
-        list.push_back(std::pair<uint64_t, std::string>(p->key, p->val));
-        p = p->forwards[0];
+void MemTableIterator::seekToLast()
+{
+    MemNode *p = table->head;
+    for (int i = MAX_LEVEL - 1; i >= 0; --i) {
+        MemNode *next = p->next(i);
+        while (next->type != MemNodeType::NIL) {
+            p = next;
+            next = p->next(i);
+        }
     }
+    node = (p == table->head) ? table->tail : p;
+    skipBackward();
 }
 
 /**
- * @brief Delete the MemTable and release its memory space
+ * @brief Move to the last node whose key <= key. O(logn)
  */
-void MemTable::deleteTable()
+void MemTableIterator::seekForPrev(uint64_t key)
 {
-    /* Make MemTable empty */
-    MemNode *p1 = head;
-    MemNode *p2;
-    while (p1) {
-        p2 = p1->forwards[0];
-        delete p1;
-        p1 = p2;
+    MemNode *p = table->head;
+    for (int i = MAX_LEVEL - 1; i >= 0; --i) {
+        MemNode *next = p->next(i);
+        while (next->type != MemNodeType::NIL && next->key <= key) {
+            p = next;
+            next = p->next(i);
+        }
     }
+    node = (p == table->head) ? table->tail : p;
+    skipBackward();
 }
 
 /**
- * @details This is designed to fix the bug in get(key) that appears in delete().
- *          If the k-v pair is deleted in memtable, the get function will simply return "", which will make delete() continue to run.
- * @brief Judge whether the key is deleted in memtable or not.
- * @param key
- * @return true: if deleted; false: else.
+ * @brief Move to the node before the current one. O(logn)
  */
-bool MemTable::isDeleted(uint64_t key)
+void MemTableIterator::prev()
 {
-    /* Search for key */
-    MemNode *p = head;
+    seekBefore(node->key);
+    skipBackward();
+}
+
+/**
+ * @brief Move to the last node whose key < key. O(logn)
+ */
+void MemTableIterator::seekBefore(uint64_t key)
+{
+    MemNode *p = table->head;
     for (int i = MAX_LEVEL - 1; i >= 0; --i) {
-        while (p->forwards[i]->key < key) {
-            p = p->forwards[i];
+        MemNode *next = p->next(i);
+        while (next->type != MemNodeType::NIL && next->key < key) {
+            p = next;
+            next = p->next(i);
         }
     }
-    p = p->forwards[0];
-
-    /* Judge if p->val equals to "~DELETE~" */
-    if (p->key == key && p->val == "~DELETE~") return true;
-    else return false;
-}
\ No newline at end of file
+    node = (p == table->head) ? table->tail : p;
+}
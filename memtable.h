@@ -2,14 +2,17 @@
 #pragma once
 
 #include <vector>
-#include <list>
 #include <string>
 #include <cstdint>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include "sstable.h"
+#include "arena.h"
+#include "iterator.h"
 
 
-#define MAX_LEVEL 8
-#define MAX_BYTE 2 * 1024 * 1024
+#define MAX_LEVEL 16                //Height cap of the skip list, enough for the biggest MemTable Options allow
 
 enum MemNodeType
 {
@@ -18,62 +21,149 @@ enum MemNodeType
     NIL
 };
 
+/**
+ * A value in the arena. Values are replaced as a whole and never changed in place, so readers need no lock.
+ * The values of a node form a list from the newest write down, for readers that look at an older sequence.
+ */
+struct MemValue
+{
+    uint64_t sequence;              //Position of the write in the log: an older write never replaces a newer one
+    std::atomic<MemValue *> older;  //Value of the write before this one, nullptr if none
+    uint32_t len;
+    char data[1];                   //First of len bytes, the rest follow the struct
+};
+
+/**
+ * Skiplist node, allocated in the arena of its MemTable with its tower of height forward pointers inline
+ * and its first value right behind the tower.
+ * A node is linked bottom-up with compare-and-swap, so a reader sees it on every level once it sees it on level 0
+ * going down, and never sees it half built.
+ */
 struct MemNode
 {
     uint64_t key;
-    std::string val;
+    std::atomic<MemValue *> val;
     MemNodeType type;
-    std::vector<MemNode *> forwards;
-    MemNode(uint64_t _key, const std::string &_val, MemNodeType _type)
-            : key(_key), val(_val), type(_type)
-    {
-        for (int i = 0; i < MAX_LEVEL; ++i)
-            forwards.push_back(nullptr);
+    int height;
+    std::atomic<MemNode *> forwards[1];     //First of height pointers, the rest follow the struct
+
+    MemNode *next(int i) const {return forwards[i].load(std::memory_order_acquire);}
+
+    MemValue *load() const {return val.load(std::memory_order_acquire);}
+
+    /* Newest value written at or before sequence, nullptr if the key was first written after it */
+    MemValue *load(uint64_t sequence) const {
+        MemValue *v = load();
+        while (v != nullptr && v->sequence > sequence) v = v->older.load(std::memory_order_acquire);
+        return v;
     }
 };
 
+/**
+ * Skiplist of K-V pairs, one node per key.
+ * put/putSorted may run in any number of threads at once and alongside readers; deleteTable may not.
+ */
 class MemTable
 {
+    friend class MemTableIterator;
+
 private:
-    int byteSize;
-    int NumOfMemNode;
-    uint64_t minKey;
-    uint64_t maxKey;
+    std::atomic<int> byteSize;      //Header, dictionary and values of the SSTable this table would become
+    std::atomic<int> NumOfMemNode;
+    int bitsPerKey;                 //Bloom filter bits per key of the SSTable
+    std::atomic<uint64_t> minKey;
+    std::atomic<uint64_t> maxKey;
+    Arena *arena;                   //Holds every node and value, freed as a whole
     MemNode *head;
     MemNode *tail;
-    unsigned long long s = 1;
+    std::atomic<int> refs;          //Holders: the store (as mem or imm), plus open iterators
     double my_rand();
     int randomLevel();
+    MemNode *newNode(uint64_t key, const std::string &val, uint64_t sequence, MemNodeType type, int height);
+    MemValue *newValue(const std::string &val, uint64_t sequence);
+    void setValue(MemNode *node, MemValue *val);
+    bool insert(uint64_t key, const std::string &val, uint64_t sequence, MemNode **preds);
+    void init();
 
 public:
-    MemTable() {
-        byteSize = 10240 + 32;
-        NumOfMemNode = 0;
-        minKey = UINT64_MAX;
-        maxKey = 0;
-        head = new MemNode(0, "", MemNodeType::HEAD);
-        tail = new MemNode(UINT64_MAX, "", MemNodeType::NIL);
-        for (int i = 0; i < MAX_LEVEL; ++i)
-            head->forwards[i] = tail;
+    MemTable(int _bitsPerKey = BITS_PER_KEY) {
+        bitsPerKey = _bitsPerKey;
+        refs = 1;
+        init();
     }
 
-    void put(uint64_t key, const std::string &val);
+    void ref(){++refs;}
+
+    void unref();
+
+    void put(uint64_t key, const std::string &val, uint64_t sequence);
+
+    void putSorted(const std::vector<const std::pair<uint64_t, std::string> *> &pairs, uint64_t sequence);
 
     std::string get(uint64_t key);
 
-    bool del(uint64_t key);
+    bool find(uint64_t key, std::string &val, uint64_t sequence = UINT64_MAX);
 
-    void reset();
+    void getSorted(const uint64_t *keys, uint64_t num, std::string *vals, uint64_t sequence = UINT64_MAX);
 
-    void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list);
+    int getByteSize();
 
-    int getByteSize(){return byteSize;}
+    uint64_t byteSizeAfter(uint64_t newKeys, uint64_t newBytes);
 
-    void deleteTable();
+    bool isEmpty(){return NumOfMemNode == 0;}
+
+    size_t memoryUsage(){return arena->memoryUsage();}
 
-    void createSSTable(std::vector<SSTable *> &SSVec, uint64_t timeStamp, const std::string &filePath);
+    void deleteTable();
 
-    bool isDeleted(uint64_t key);
+    SSTable *createSSTable(uint64_t timeStamp, const std::string &filePath, BlockCache *cache = nullptr,
+                           bool useMmap = false, CompressionType compression = COMPRESSION_NONE,
+                           uint64_t blockSize = SSTABLE_BLOCK_SIZE);
 
 };
 
+/**
+ * Cursor over the nodes of a MemTable, as of the writes up to sequence: later values are passed over for older
+ * ones, and keys first written after it are skipped. The MemTable must outlive the iterator.
+ * Nodes have no back links, so prev() searches from the head. O(logn)
+ */
+class MemTableIterator : public Iterator
+{
+private:
+    MemTable *table;
+    MemNode *node;
+    uint64_t sequence;
+    std::string val;                //Copy of the value at node, made by value()
+
+    void seekBefore(uint64_t key);
+
+    void skipForward();
+
+    void skipBackward();
+
+public:
+    MemTableIterator(MemTable *_table, uint64_t _sequence = UINT64_MAX)
+            : table(_table), node(_table->tail), sequence(_sequence) {}
+
+    bool valid() override {return node->type != MemNodeType::NIL;}
+
+    void seekToFirst() override;
+
+    void seekToLast() override;
+
+    void seek(uint64_t key) override;
+
+    void seekForPrev(uint64_t key) override;
+
+    void next() override;
+
+    void prev() override;
+
+    uint64_t key() override {return node->key;}
+
+    const std::string &value() override {
+        MemValue *v = node->load(sequence);
+        val.assign(v->data, v->len);
+        return val;
+    }
+};
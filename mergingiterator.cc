@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "mergingiterator.h"
+
+MergingIterator::~MergingIterator()
+{
+    for (Iterator *it : children)
+        delete it;
+}
+
+/**
+ * @brief Refill the heap from the positioned children
+ * @param forward direction of the following moves
+ */
+void MergingIterator::rebuild(bool forward)
+{
+    isForward = forward;
+    heap.clear();
+    uint64_t size = children.size();
+    for (uint64_t i = 0; i < size; ++i) {
+        if (children[i]->valid())
+            heap.push_back(HeapNode(children[i]->key(), i));
+    }
+    std::make_heap(heap.begin(), heap.end(), HeapOrder{isForward});
+}
+
+void MergingIterator::push(uint64_t index)
+{
+    heap.push_back(HeapNode(children[index]->key(), index));
+    std::push_heap(heap.begin(), heap.end(), HeapOrder{isForward});
+}
+
+void MergingIterator::pop()
+{
+    std::pop_heap(heap.begin(), heap.end(), HeapOrder{isForward});
+    heap.pop_back();
+}
+
+void MergingIterator::seekToFirst()
+{
+    for (Iterator *it : children)
+        it->seekToFirst();
+    rebuild(true);
+}
+
+void MergingIterator::seekToLast()
+{
+    for (Iterator *it : children)
+        it->seekToLast();
+    rebuild(false);
+}
+
+void MergingIterator::seek(uint64_t key)
+{
+    for (Iterator *it : children)
+        it->seek(key);
+    rebuild(true);
+}
+
+void MergingIterator::seekForPrev(uint64_t key)
+{
+    for (Iterator *it : children)
+        it->seekForPrev(key);
+    rebuild(false);
+}
+
+/**
+ * @brief Move past the current key in every child that holds it (older versions are dropped here).
+ *        After a backward move the children stand anywhere before the current key, so they are re-seeked.
+ */
+void MergingIterator::next()
+{
+    uint64_t current = key();
+    if (!isForward) {
+        if (current == UINT64_MAX) heap.clear();
+        else seek(current + 1);
+        return;
+    }
+    while (!heap.empty() && heap.front().key == current) {
+        uint64_t index = heap.front().index;
+        pop();
+        children[index]->next();
+        if (children[index]->valid()) push(index);
+    }
+}
+
+/**
+ * @brief Mirror of next(): move every child holding the current key to its previous pair.
+ */
+void MergingIterator::prev()
+{
+    uint64_t current = key();
+    if (isForward) {
+        if (current == 0) heap.clear();
+        else seekForPrev(current - 1);
+        return;
+    }
+    while (!heap.empty() && heap.front().key == current) {
+        uint64_t index = heap.front().index;
+        pop();
+        children[index]->prev();
+        if (children[index]->valid()) push(index);
+    }
+}
+
+/**
+ * @return true if any child reported an error
+ */
+bool MergingIterator::hasError()
+{
+    for (Iterator *it : children) {
+        if (it->hasError()) return true;
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+#include "iterator.h"
+
+/**
+ * Merges child iterators into one ordered stream, forward or backward. children[0] is the newest source:
+ * when several children hold the same key, only the version of the first of them is returned, the others
+ * are skipped. Deletions ("~DELETE~") are returned like values, callers drop them if they want to.
+ * Owns (and deletes) its children.
+ */
+class MergingIterator : public Iterator
+{
+private:
+    /* Heap entry: the child's current key, and the child's position (smaller: newer) */
+    struct HeapNode
+    {
+        uint64_t key;
+        uint64_t index;
+        HeapNode(uint64_t _key, uint64_t _index) : key(_key), index(_index) {}
+    };
+
+    /* Heap order: the top is the smallest key going forward, the biggest going backward; the newer child on ties */
+    struct HeapOrder
+    {
+        bool isForward;
+        bool operator()(const HeapNode &a, const HeapNode &b) const {
+            if (a.key != b.key) return isForward ? a.key > b.key : a.key < b.key;
+            return a.index > b.index;
+        }
+    };
+
+    std::vector<Iterator *> children;
+    std::vector<HeapNode> heap;
+    bool isForward;
+
+    void rebuild(bool forward);
+
+    void push(uint64_t index);
+
+    void pop();
+
+public:
+    MergingIterator(const std::vector<Iterator *> &_children) : children(_children), isForward(true) {}
+
+    ~MergingIterator();
+
+    bool valid() override {return !heap.empty();}
+
+    void seekToFirst() override;
+
+    void seekToLast() override;
+
+    void seek(uint64_t key) override;
+
+    void seekForPrev(uint64_t key) override;
+
+    void next() override;
+
+    void prev() override;
+
+    uint64_t key() override {return heap.front().key;}
+
+    const std::string &value() override {return children[heap.front().index]->value();}
+
+    bool hasError() override;
+};
@@ -0,0 +1,156 @@
+#include <sstream>
+#include <cstdlib>
+
+#include "options.h"
+#include "utils.h"
+
+/**
+ * @brief Bring every option into the range the store works with: values out of range are clamped,
+ *        unknown enum values go back to their default.
+ * @param fixes if given, a "name=old changed to new" line is added for every option changed
+ * @return true if nothing had to be changed
+ */
+bool Options::sanitize(std::vector<std::string> *fixes)
+{
+    Options defaults;
+    bool isValid = true;
+    auto report = [&isValid, fixes](const char *name, const std::string &from, const std::string &to) {
+        isValid = false;
+        if (fixes != nullptr) fixes->push_back(std::string(name) + "=" + from + " changed to " + to);
+    };
+    auto clamp = [&report](const char *name, uint64_t &value, uint64_t low, uint64_t high) {
+        uint64_t fixed = (value < low) ? low : (value > high) ? high : value;
+        if (fixed != value) report(name, std::to_string(value), std::to_string(fixed));
+        value = fixed;
+    };
+    /* MemTable sizes are kept in an int */
+    clamp("memtable_bytes", memTableBytes, 64 * 1024, 1024 * 1024 * 1024);
+    if (bitsPerKey < MIN_BITS_PER_KEY || bitsPerKey > 64) {
+        int fixed = (bitsPerKey < MIN_BITS_PER_KEY) ? MIN_BITS_PER_KEY : 64;
+        report("bits_per_key", std::to_string(bitsPerKey), std::to_string(fixed));
+        bitsPerKey = fixed;
+    }
+    clamp("block_size", blockSize, 256, 1024 * 1024);
+    clamp("l0_compaction_trigger", l0CompactionTrigger, 1, 64);
+    clamp("level_size_multiplier", levelSizeMultiplier, 2, 100);
+    clamp("dynamic_level_multiplier", dynamicLevelMultiplier, 2, 100);
+    if (compactionStyle < COMPACTION_LEVELED || compactionStyle > COMPACTION_UNIVERSAL) {
+        report("compaction_style", std::to_string(compactionStyle), std::to_string(defaults.compactionStyle));
+        compactionStyle = defaults.compactionStyle;
+    }
+    if (syncMode < SYNC_NONE || syncMode > SYNC_GROUP) {
+        report("sync_mode", std::to_string(syncMode), std::to_string(defaults.syncMode));
+        syncMode = defaults.syncMode;
+    }
+    for (CompressionType &type : compression) {
+        if (type != COMPRESSION_NONE && type != COMPRESSION_LZ) {
+            report("compression", std::to_string(type), std::to_string(COMPRESSION_NONE));
+            type = COMPRESSION_NONE;
+        }
+    }
+    if (compression.empty()) {
+        report("compression", "", std::to_string(COMPRESSION_NONE));
+        compression.push_back(COMPRESSION_NONE);
+    }
+    return isValid;
+}
+
+/**
+ * @return The options as "name=value" lines, compression as the codec of each level separated by ','
+ */
+std::string Options::encode() const
+{
+    std::ostringstream out;
+    out << "memtable_bytes=" << memTableBytes << "\n";
+    out << "cache_capacity=" << cacheCapacity << "\n";
+    out << "bits_per_key=" << bitsPerKey << "\n";
+    out << "block_size=" << blockSize << "\n";
+    out << "compaction_style=" << compactionStyle << "\n";
+    out << "l0_compaction_trigger=" << l0CompactionTrigger << "\n";
+    out << "level_size_multiplier=" << levelSizeMultiplier << "\n";
+    out << "dynamic_level_multiplier=" << dynamicLevelMultiplier << "\n";
+    out << "compression=";
+    for (uint64_t i = 0; i < compression.size(); ++i)
+        out << (i ? "," : "") << compression[i];
+    out << "\n";
+    out << "use_mmap=" << useMmap << "\n";
+    out << "sync_mode=" << syncMode << "\n";
+    return out.str();
+}
+
+/**
+ * @brief Set the options named in text (as written by encode). Options it does not name keep their value,
+ *        unknown names are skipped, so files of other versions still load.
+ * @return false if a line is not "name=number", or a known option has no valid number
+ */
+bool Options::decode(const std::string &text)
+{
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) return false;
+        std::string name = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+
+        if (name == "compression") {
+            std::vector<CompressionType> types;
+            std::istringstream list(value);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                char *end;
+                uint64_t type = strtoull(item.c_str(), &end, 10);
+                if (item.empty() || *end != '\0') return false;
+                types.push_back((CompressionType) type);
+            }
+            compression = types;
+            continue;
+        }
+
+        char *end;
+        uint64_t number = strtoull(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0') return false;
+        if (name == "memtable_bytes") memTableBytes = number;
+        else if (name == "cache_capacity") cacheCapacity = number;
+        else if (name == "bits_per_key") bitsPerKey = (int) number;
+        else if (name == "block_size") blockSize = number;
+        else if (name == "compaction_style") compactionStyle = (CompactionStyle) number;
+        else if (name == "l0_compaction_trigger") l0CompactionTrigger = number;
+        else if (name == "level_size_multiplier") levelSizeMultiplier = number;
+        else if (name == "dynamic_level_multiplier") dynamicLevelMultiplier = number;
+        else if (name == "use_mmap") useMmap = number != 0;
+        else if (name == "sync_mode") syncMode = (WALSyncMode) number;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the options to "dir/OPTIONS": into a temporary file first, which replaces the old one once synced
+ * @return true if saved
+ */
+bool Options::save(const std::string &dir) const
+{
+    std::string path = dir + "/" + OPTIONS_NAME;
+    std::string tmpPath = path + ".tmp";
+    int fd = utils::openAppend(tmpPath.c_str(), true);
+    if (fd < 0) return false;
+    std::string text = encode();
+    bool ok = utils::writeAll(fd, text.data(), text.size()) == 0 && utils::syncFile(fd) == 0;
+    utils::closeFile(fd);
+    return ok && utils::renameFile(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief Read the options saved in "dir/OPTIONS" into this. They are not checked: see sanitize.
+ * @return false if there is no such file, or it does not parse (this then keeps its values)
+ */
+bool Options::load(const std::string &dir)
+{
+    std::string text;
+    if (utils::readFile((dir + "/" + OPTIONS_NAME).c_str(), text) != 0) return false;
+    Options saved = *this;
+    if (!saved.decode(text)) return false;
+    *this = saved;
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bloomfilter.h"
+#include "blockcache.h"
+#include "compression.h"
+#include "sstable.h"
+#include "wal.h"
+
+#define OPTIONS_NAME "OPTIONS"
+
+#define DEFAULT_MEMTABLE_BYTES (2 * 1024 * 1024)
+#define DEFAULT_L0_COMPACTION_TRIGGER 3
+#define DEFAULT_LEVEL_SIZE_MULTIPLIER 2
+#define DEFAULT_DYNAMIC_LEVEL_MULTIPLIER 10
+
+/**
+ * How the store compacts, chosen per store
+ * @param COMPACTION_LEVELED level i holds 2 * levelSizeMultiplier ^ i files; all of level0 or the oldest
+ *        overflow files move down
+ * @param COMPACTION_LEVELED_DYNAMIC level sizes are derived from the last level, so most data sits there
+ * @param COMPACTION_TIERED merge runs of similar size once there are enough of them
+ * @param COMPACTION_UNIVERSAL merge the newest runs while they are small next to the older ones, and everything
+ *        when the newer runs get too big next to the oldest
+ */
+enum CompactionStyle
+{
+    COMPACTION_LEVELED = 1,
+    COMPACTION_LEVELED_DYNAMIC,
+    COMPACTION_TIERED,
+    COMPACTION_UNIVERSAL
+};
+
+/**
+ * Everything a store can be tuned with at runtime. A store saves the options it runs with to "dir/OPTIONS"
+ * as "name=value" lines, and opening it without options takes them from there.
+ */
+struct Options
+{
+    uint64_t memTableBytes;         //Size of the SSTable a MemTable is flushed as, also of compaction outputs
+    uint64_t cacheCapacity;         //Bytes of the block cache shared by all SSTables
+    int bitsPerKey;                 //Bloom filter bits per key of new SSTables, MIN_BITS_PER_KEY to 64
+    uint64_t blockSize;             //A data block of a new SSTable is closed once it holds this many bytes
+    CompactionStyle compactionStyle;
+    uint64_t l0CompactionTrigger;   //Leveled styles: compact level0 once it has this many files
+    uint64_t levelSizeMultiplier;   //Leveled: files level i + 1 may hold / files level i may hold (i > 0)
+    uint64_t dynamicLevelMultiplier;        //Dynamic leveled: target size of a level / that of the level above
+    std::vector<CompressionType> compression;       //Codec of new SSTables of level i, the last one for deeper levels
+    bool useMmap;                   //Map every SSTable file and read values in place
+    WALSyncMode syncMode;
+
+    /* Level0 is rewritten soon, deeper levels hold the bulk of the data: by default only they are compressed */
+    Options() : memTableBytes(DEFAULT_MEMTABLE_BYTES), cacheCapacity(CACHE_CAPACITY), bitsPerKey(BITS_PER_KEY),
+                blockSize(SSTABLE_BLOCK_SIZE), compactionStyle(COMPACTION_LEVELED),
+                l0CompactionTrigger(DEFAULT_L0_COMPACTION_TRIGGER), levelSizeMultiplier(DEFAULT_LEVEL_SIZE_MULTIPLIER),
+                dynamicLevelMultiplier(DEFAULT_DYNAMIC_LEVEL_MULTIPLIER),
+                compression({COMPRESSION_NONE, COMPRESSION_LZ}), useMmap(false), syncMode(SYNC_NONE) {}
+
+    bool sanitize(std::vector<std::string> *fixes = nullptr);
+
+    std::string encode() const;
+
+    bool decode(const std::string &text);
+
+    bool save(const std::string &dir) const;
+
+    bool load(const std::string &dir);
+};
@@ -1,94 +1,599 @@
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+
+#include <algorithm>
 
 #include "sstable.h"
 #include "utils.h"
+#include "coding.h"
+#include "compression.h"
+
+/**
+ * @brief Hand out a process-wide unique id, so cache entries of a deleted SSTable can never be hit by a later one.
+ */
+uint64_t SSTable::newId()
+{
+    static std::atomic<uint64_t> nextId(1);
+    return nextId++;
+}
+
+/**
+ * @brief Get the file number out of a path ending with "sstable<number>.sst".
+ * @return the number, 0 if the name does not follow the pattern.
+ */
+uint64_t SSTable::parseNumber(const std::string &path)
+{
+    size_t pos = path.rfind("sstable");
+    if (pos == std::string::npos) return 0;
+    return strtoull(path.c_str() + pos + 7, nullptr, 10);
+}
 
 /**
- * @brief Load SSTable to cache.
+ * @brief Open an SSTable. Only the header is read; the filter and dic (v2: index) wait for the first load().
  * @param path the file path of SSTable
+ * @param c shared value cache (nullptr: no cache)
+ * @param _useMmap map the file once it is loaded and read everything in place
+ * @param h header of the file if it is known already (e.g. from the MANIFEST), so nothing is read at all
  */
-SSTable::SSTable(const std::string &path)
+SSTable::SSTable(const std::string &path, BlockCache *c, bool _useMmap, SSInfo *h)
+        : header(h), bf(nullptr), isBlockBased(false), numDeletes(0), file_path(path), number(parseNumber(path)),
+          id(newId()), cache(c), mapData(nullptr), mapSize(0), fileBytes(utils::fileSize(path)), refs(1),
+          isObsolete(false), useMmap(_useMmap), isLoaded(false), isMetaCorrupt(false)
 {
-    /* Define some variables used in this function */
-    char buf[CAPACITY];
-    uint64_t _timeStamp;
-    uint64_t  _num;
-    uint64_t  _minKey;
-    uint64_t  _maxKey;
-    uint64_t _key;
-    uint32_t _offset;
+    if (!header) readHeader();
+}
 
-    /* Load header, bloomfilter, dic from disk */
-    std::ifstream out(path, std::ios::in | std::ios::binary);
+/**
+ * @brief Read the first 32 bytes of the file into header
+ */
+void SSTable::readHeader()
+{
+    uint64_t _timeStamp = 0;
+    uint64_t _num = 0;
+    uint64_t _minKey = 0;
+    uint64_t _maxKey = 0;
+    std::ifstream out(file_path, std::ios::in | std::ios::binary);
     out.read((char *) &_timeStamp, 8);
     out.read((char *) &_num, 8);
     out.read((char *) &_minKey, 8);
     out.read((char *) &_maxKey, 8);
-    out.read(buf, CAPACITY);
     header = new SSInfo(_timeStamp, _num, _minKey, _maxKey);
-    bf = new BloomFilter(buf);
-    for (int i = 0; i < _num; ++i) {
+}
+
+/**
+ * @brief Load bloomfilter and dic (v2: index), through the mapping if useMmap. Runs once, under loadMutex.
+ *        If they can not be read whole, none of them is kept and the table is marked corrupt.
+ */
+void SSTable::loadMeta()
+{
+    std::lock_guard<std::mutex> lk(loadMutex);
+    if (isLoaded) return;
+    if (!readMeta()) {
+        delete bf;
+        bf = nullptr;
+        dic.clear();
+        index.clear();
+        isMetaCorrupt = true;
+    }
+    isLoaded.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Size of a filter section, from its first 8 bytes
+ */
+uint64_t SSTable::filterBytes(const char *head)
+{
+    if (BloomFilter::isLegacy(head)) return CAPACITY;
+    uint32_t numLines;
+    memcpy(&numLines, head + 4, 4);
+    return 8 + (uint64_t) numLines * FILTER_LINE;
+}
+
+/**
+ * @brief Read bloomfilter and dic (v2: index) for loadMeta
+ * @return false if a read came up short or a section does not fit in the file
+ */
+bool SSTable::readMeta()
+{
+    /* Define some variables used in this function */
+    char filterHead[8];
+    uint64_t _num = header->size;
+    uint64_t _key;
+    uint32_t _offset;
+    uint64_t filterOffset;
+    uint64_t indexOffset;
+    bool hasTypes;
+
+    /* Load bloomfilter, dic (v2: index) from the mapping */
+    if (useMmap && mapFile()) {
+        const char *p = mapData + 32;
+        if (mapSize >= 32 + SSTABLE_FOOTER_SIZE
+            && parseFooter(mapData + mapSize - SSTABLE_FOOTER_SIZE, mapSize, filterOffset, indexOffset, numDeletes,
+                           hasTypes)) {
+            isBlockBased = true;
+            if (filterBytes(mapData + filterOffset) > indexOffset - filterOffset) return false;
+            bf = new BloomFilter(mapData + filterOffset);
+            return parseIndex(mapData + indexOffset, mapData + mapSize - SSTABLE_FOOTER_SIZE, hasTypes);
+        }
+        /* v1: the filter and the whole dictionary must lie inside the mapping */
+        if (mapSize < 32 + 8) return false;
+        uint64_t filterSize = filterBytes(p);
+        if (filterSize > mapSize - 32 || _num > (mapSize - 32 - filterSize) / 12) return false;
+        bf = new BloomFilter(p);
+        p += filterSize;
+        dic.reserve(_num);
+        for (uint64_t i = 0; i < _num; ++i) {
+            _key = _offset = 0;
+            memcpy(&_key, p, 8);
+            memcpy(&_offset, p + 8, 4);
+            dic.push_back(std::pair<uint64_t, uint32_t>(_key, _offset));
+            p += 12;
+        }
+        return true;
+    }
+
+    /* Load bloomfilter, dic from disk */
+    std::ifstream out(file_path, std::ios::in | std::ios::binary);
+    /* A block-based file ends with its footer: load filter and index, the data blocks are read on demand */
+    if (fileBytes >= 32 + SSTABLE_FOOTER_SIZE) {
+        char footer[SSTABLE_FOOTER_SIZE];
+        out.seekg(fileBytes - SSTABLE_FOOTER_SIZE, out.beg);
+        out.read(footer, SSTABLE_FOOTER_SIZE);
+        if (out && parseFooter(footer, fileBytes, filterOffset, indexOffset, numDeletes, hasTypes)) {
+            isBlockBased = true;
+            std::string meta(fileBytes - SSTABLE_FOOTER_SIZE - filterOffset, '\0');
+            out.seekg(filterOffset, out.beg);
+            out.read(&meta[0], meta.size());
+            if (!out || filterBytes(meta.data()) > indexOffset - filterOffset) return false;
+            bf = new BloomFilter(meta.data());
+            return parseIndex(meta.data() + (indexOffset - filterOffset), meta.data() + meta.size(), hasTypes);
+        }
+        out.clear();
+    }
+    out.seekg(32, out.beg);
+    /* The first bytes of the filter section tell its format and size */
+    out.read(filterHead, 8);
+    if (!out) return false;
+    uint64_t filterSize = filterBytes(filterHead);
+    if (fileBytes < 32 + filterSize || _num > (fileBytes - 32 - filterSize) / 12) return false;
+    std::vector<char> filter(filterSize);
+    memcpy(filter.data(), filterHead, 8);
+    out.read(filter.data() + 8, filterSize - 8);
+    /* The whole dictionary in one read instead of one per entry */
+    std::vector<char> entries(_num * 12);
+    out.read(entries.data(), entries.size());
+    if (!out) return false;
+    bf = new BloomFilter(filter.data());
+    dic.reserve(_num);
+    for (uint64_t i = 0; i < _num; ++i) {
         _key = _offset = 0;
-        out.read((char *) &_key, 8);
-        out.read((char *) &_offset, 4);
+        memcpy(&_key, entries.data() + i * 12, 8);
+        memcpy(&_offset, entries.data() + i * 12 + 8, 4);
         dic.push_back(std::pair<uint64_t, uint32_t>(_key, _offset));
     }
-    file_path = path;
+    return true;
+}
+
+/**
+ * @brief Check the footer of a block-based file
+ * @param footer the last SSTABLE_FOOTER_SIZE bytes of the file
+ * @param size size of the file
+ * @param hasTypes set if the index holds the codec of every block (v3)
+ * @return false if the file is not block-based (v1)
+ */
+bool SSTable::parseFooter(const char *footer, uint64_t size, uint64_t &filterOffset, uint64_t &indexOffset,
+                          uint64_t &deletes, bool &hasTypes)
+{
+    uint64_t magic = coding::decodeFixed64(footer + 24);
+    if (magic != SSTABLE_MAGIC_V2 && magic != SSTABLE_MAGIC_V3) return false;
+    hasTypes = magic == SSTABLE_MAGIC_V3;
+    filterOffset = coding::decodeFixed64(footer);
+    indexOffset = coding::decodeFixed64(footer + 8);
+    deletes = coding::decodeFixed64(footer + 16);
+    return filterOffset >= 32 && filterOffset + 8 <= indexOffset && indexOffset <= size - SSTABLE_FOOTER_SIZE;
+}
+
+/**
+ * @brief Decode the index of a block-based file into index. The data blocks start right after the header.
+ * @param hasTypes every entry ends with the codec of its block (v3), else all blocks are raw
+ * @return false if it is truncated
+ */
+bool SSTable::parseIndex(const char *p, const char *limit, bool hasTypes)
+{
+    uint64_t num, delta, size;
+    uint64_t type = COMPRESSION_NONE;
+    uint64_t lastKey = 0;
+    uint64_t offset = 32;
+    if (!coding::getVarint64(p, limit, num)) return false;
+    index.reserve(num);
+    for (uint64_t i = 0; i < num; ++i) {
+        if (!coding::getVarint64(p, limit, delta) || !coding::getVarint64(p, limit, size)) return false;
+        if (hasTypes && !coding::getVarint64(p, limit, type)) return false;
+        lastKey += delta;
+        index.push_back(BlockHandle(lastKey, offset, size, (CompressionType) type));
+        offset += size;
+    }
+    return true;
+}
+
+/**
+ * @brief Decode the K-V pairs of a data block, in key order
+ * @return false if the block is corrupt (entries holds the pairs before the damage)
+ */
+bool SSTable::decodeBlock(const char *data, uint64_t size, std::vector<BlockEntry> &entries)
+{
+    const char *p = data;
+    const char *limit = data + size;
+    uint64_t key = 0;
+    uint64_t delta, len;
+    entries.clear();
+    while (p < limit) {
+        if (!coding::getVarint64(p, limit, delta) || !coding::getVarint64(p, limit, len)) return false;
+        if (len > (uint64_t) (limit - p)) return false;
+        key += delta;
+        entries.push_back(BlockEntry{key, p, len});
+        p += len;
+    }
+    return true;
+}
+
+/**
+ * @return The first block at or after from whose last key >= key, index.size() if none
+ */
+uint64_t SSTable::findBlock(uint64_t key, uint64_t from)
+{
+    uint64_t left = from;
+    uint64_t right = index.size();
+    while (left < right) {
+        uint64_t mid = (left + right) / 2;
+        if (index[mid].lastKey < key) left = mid + 1;
+        else right = mid;
+    }
+    return left;
+}
+
+/**
+ * @brief Get the uncompressed bytes of data block b: a raw block in place from the mapping, else from the cache,
+ *        else from disk. Blocks are cached uncompressed, so a hot block is decompressed once.
+ * @param fillCache false: still use cached blocks, but do not add the one read from disk (used by compaction).
+ * @return false if it can not be read
+ */
+bool SSTable::readBlock(uint64_t b, BlockContents &block, bool fillCache)
+{
+    const BlockHandle &h = index[b];
+    block.holder.reset();
+    if (mapData && h.offset + h.size > mapSize) return false;
+    if (mapData && h.type == COMPRESSION_NONE) {
+        block.data = mapData + h.offset;
+        block.size = h.size;
+        return true;
+    }
+    if (cache) block.holder = cache->lookup(id, h.offset);
+    if (block.holder) {
+        block.data = block.holder->data();
+        block.size = block.holder->size();
+        return true;
+    }
+    if (mapData) return unpackBlock(b, mapData + h.offset, block, fillCache);
+    std::string raw(h.size, '\0');
+    std::ifstream in(file_path, std::ios::in | std::ios::binary);
+    in.seekg(h.offset, in.beg);
+    in.read(&raw[0], h.size);
+    if (!in) return false;
+    return unpackBlock(b, raw.data(), block, fillCache);
+}
+
+/**
+ * @brief Get the uncompressed bytes of data block b from its bytes on disk, and cache them if asked
+ * @param raw the h.size bytes of the block as they are in the file
+ * @return false if they do not uncompress
+ */
+bool SSTable::unpackBlock(uint64_t b, const char *raw, BlockContents &block, bool fillCache)
+{
+    const BlockHandle &h = index[b];
+    std::string buf;
+    if (h.type == COMPRESSION_NONE) buf.assign(raw, h.size);
+    else if (!compression::uncompress(h.type, raw, h.size, buf)) return false;
+    if (cache && fillCache) block.holder = cache->insert(id, h.offset, buf);
+    else block.holder = std::make_shared<const std::string>(std::move(buf));
+    block.data = block.holder->data();
+    block.size = block.holder->size();
+    return true;
+}
+
+/**
+ * @brief Map the whole SSTable file, so values are read in place instead of through ifstream.
+ *        Point lookups dominate, so the mapping starts with random-access advice.
+ * @return true if the file is mapped.
+ */
+bool SSTable::mapFile()
+{
+    if (mapData) return true;
+    mapData = utils::mmapFile(file_path.c_str(), mapSize);
+    if (mapData) utils::madviseFile(mapData, mapSize, utils::MAP_RANDOM);
+    return mapData != nullptr;
 }
 
 /**
  * Get value string according to key
  * @param key key to be searched.
+ * @param isCorrupt set if the block that may hold key could not be read: "" then does not mean not found.
+ * @param fillCache false: still use cached values, but do not add the value read from disk (used by compaction).
  * @return value string if found, "~DELETE" if deleted, "" else.
  */
-std::string SSTable::get(uint64_t key)
+std::string SSTable::get(uint64_t key, bool &isCorrupt, bool fillCache)
 {
     uint32_t offset;
     uint32_t len = 0;
-    char *buf;
-    std::ifstream out;
 
+    isCorrupt = false;
     /* Key out of range */
     if (key < header->minKey || key > header->maxKey) return "";
+    load();
+    /* Without the filter and dic nothing can be found here, nor ruled out */
+    if (isMetaCorrupt) {
+        isCorrupt = true;
+        return "";
+    }
     /* Not Found in BloomFilter */
-    else if (bf->isFind(key) == false) return "";
+    if (bf->isFind(key) == false) return "";
+    /* Block-based: search the only block that may hold key */
+    else if (isBlockBased) {
+        uint64_t b = findBlock(key);
+        BlockContents block;
+        std::vector<BlockEntry> entries;
+        if (b == index.size()) return "";
+        if (!readBlock(b, block, fillCache)) {
+            isCorrupt = true;
+            return "";
+        }
+        /* A damaged block still holds the pairs before the damage */
+        bool isWhole = decodeBlock(block.data, block.size, entries);
+        auto it = std::lower_bound(entries.begin(), entries.end(), key,
+                                   [](const BlockEntry &e, uint64_t k) { return e.key < k; });
+        if (it == entries.end() || it->key != key) {
+            isCorrupt = !isWhole;
+            return "";
+        }
+        return std::string(it->value, it->len);
+    }
     /* Not Found in Dic */
     else if (getOffSet(key, offset, len) == false) return "";
+    /* Mapped: the page cache already holds the value, skip the value cache */
+    else if (mapData) return readValue(offset, len);
+    /* Found in cache */
+    else if (cache) {
+        CacheHandle h = cache->lookup(id, offset);
+        if (h) return *h;
+        std::string val = readValue(offset, len);
+        if (fillCache) cache->insert(id, offset, val);
+        return val;
+    }
     /* Found in Dic */
-    else {
-        out.open(file_path, std::ios::in | std::ios::binary);
-        out.seekg(offset, out.beg);
-        /* Value locate in the end of file */
-        if (len == 0) {
-            out.seekg(0, out.end);
-            uint64_t fileSize = out.tellg();
-            out.seekg(offset, out.beg);
-            buf = new char[fileSize - offset + 1];
-            out.read(buf, fileSize - offset);
-            buf[fileSize - offset] = '\0';
+    else return readValue(offset, len);
+}
+
+/**
+ * @brief Look up ascending keys in one pass: the Bloom filter is probed for the whole batch, the dictionary
+ *        search starts from the previous hit, and the values of neighbouring hits are read from disk together.
+ * @param vals set like get: the value, "~DELETE~" if deleted, "" if not in this SSTable
+ * @param unreadable increased by the keys whose block could not be read (v2)
+ */
+void SSTable::getSorted(const uint64_t *keys, uint64_t num, std::string *vals, uint64_t &unreadable)
+{
+    load();
+    /* Like an unreadable block: no older SSTable may answer for the keys in range */
+    if (isMetaCorrupt) {
+        for (uint64_t k = 0; k < num; ++k) {
+            bool inRange = header->minKey <= keys[k] && keys[k] <= header->maxKey;
+            vals[k] = inRange ? "~DELETE~" : "";
+            if (inRange) ++unreadable;
         }
-        /* Read value according to len */
-        else {
-            buf = new char[len + 1];
-            out.read(buf, len);
-            buf[len] = '\0';
+        return;
+    }
+    if (isBlockBased) {
+        getSortedBlocks(keys, num, vals, unreadable);
+        return;
+    }
+    /* Hits as (index in keys, index in dic) */
+    std::vector<std::pair<uint64_t, uint64_t>> hits;
+    uint64_t lower = 0;
+    uint64_t dicSize = dic.size();
+    for (uint64_t k = 0; k < num; ++k) {
+        vals[k] = "";
+        if (keys[k] < header->minKey || keys[k] > header->maxKey || !bf->isFind(keys[k])) continue;
+        /* Keys ascend, so the dictionary search never moves back */
+        uint64_t left = lower;
+        uint64_t right = dicSize;
+        while (left < right) {
+            uint64_t mid = (left + right) / 2;
+            if (dic[mid].first < keys[k]) left = mid + 1;
+            else right = mid;
         }
-        out.close();
-        /* the value is "~DELETE~", return "~DELETE~" */
-        if (strcmp(buf, "~DELETE~") == 0) {
-            delete[] buf;
-            return "~DELETE~";
+        lower = left;
+        if (left < dicSize && dic[left].first == keys[k]) hits.push_back(std::pair<uint64_t, uint64_t>(k, left));
+    }
+    if (hits.empty()) return;
+
+    /* Values in the cache (or the mapping) need no read */
+    std::vector<std::pair<uint64_t, uint64_t>> misses;
+    for (std::pair<uint64_t, uint64_t> &h : hits) {
+        uint32_t offset = dic[h.second].second;
+        uint32_t len = (h.second + 1 < dicSize) ? dic[h.second + 1].second - offset : 0;
+        if (mapData) vals[h.first] = readValue(offset, len);
+        else if (cache) {
+            CacheHandle c = cache->lookup(id, offset);
+            if (c) vals[h.first] = *c;
+            else misses.push_back(h);
         }
-        /* return value string */
-        else {
-            std::string retStr = std::string(buf);
-            delete[] buf;
-            return retStr;
+        else misses.push_back(h);
+    }
+    if (misses.empty()) return;
+
+    std::ifstream in(file_path, std::ios::in | std::ios::binary);
+    in.seekg(0, in.end);
+    uint64_t fileSize = in.tellg();
+    std::string buf;
+    uint64_t i = 0;
+    while (i < misses.size()) {
+        /* Extend the read over the next hits while the gap to them is small */
+        uint64_t j = i;
+        uint64_t start = dic[misses[i].second].second;
+        while (j + 1 < misses.size()) {
+            uint64_t end = dic[misses[j].second + 1].second;
+            if (dic[misses[j + 1].second].second - end > MULTIGET_READ_GAP) break;
+            ++j;
+        }
+        uint64_t end = (misses[j].second + 1 < dicSize) ? dic[misses[j].second + 1].second : fileSize;
+        if (end > fileSize) end = fileSize;
+        if (start > end) start = end;
+        buf.assign(end - start, '\0');
+        in.clear();
+        in.seekg(start, in.beg);
+        in.read(&buf[0], end - start);
+
+        for (; i <= j; ++i) {
+            uint64_t d = misses[i].second;
+            uint64_t from = dic[d].second;
+            uint64_t to = (d + 1 < dicSize) ? dic[d + 1].second : fileSize;
+            if (to > end) to = end;
+            if (from < start || from > to) from = to;
+            const char *p = buf.data() + (from - start);
+            std::string &val = vals[misses[i].first];
+            val.assign(p, strnlen(p, to - from));
+            if (cache) cache->insert(id, dic[d].second, val);
         }
     }
 }
 
+/**
+ * @brief getSorted of a block-based file: every block is read and decoded once for all of its keys.
+ *        Blocks neither mapped nor cached are read through one open file, and like the values of a v1 file,
+ *        neighbours less than MULTIGET_READ_GAP apart are read together.
+ *        A key whose block could not be read is set to "~DELETE~": no older SSTable may answer for it.
+ */
+void SSTable::getSortedBlocks(const uint64_t *keys, uint64_t num, std::string *vals, uint64_t &unreadable)
+{
+    uint64_t none = index.size();
+    std::vector<uint64_t> blockOf(num, none);       //Block that may hold each key, none if no block does
+    std::vector<uint64_t> wanted;                   //Those blocks, ascending
+    uint64_t b = 0;
+    for (uint64_t k = 0; k < num; ++k) {
+        vals[k] = "";
+        if (keys[k] < header->minKey || keys[k] > header->maxKey || !bf->isFind(keys[k])) continue;
+        /* Keys ascend, so the block search never moves back */
+        b = findBlock(keys[k], b);
+        if (b == none) continue;
+        blockOf[k] = b;
+        if (wanted.empty() || wanted.back() != b) wanted.push_back(b);
+    }
+    if (wanted.empty()) return;
+
+    /* Blocks in the mapping or the cache need no read */
+    std::vector<BlockContents> blocks(wanted.size());
+    std::vector<bool> isRead(wanted.size(), false);
+    std::vector<uint64_t> misses;                   //Positions in wanted
+    for (uint64_t i = 0; i < wanted.size(); ++i) {
+        if (mapData) isRead[i] = readBlock(wanted[i], blocks[i]);
+        else if (cache && (blocks[i].holder = cache->lookup(id, index[wanted[i]].offset))) {
+            blocks[i].data = blocks[i].holder->data();
+            blocks[i].size = blocks[i].holder->size();
+            isRead[i] = true;
+        }
+        else misses.push_back(i);
+    }
+
+    std::ifstream in;
+    if (!misses.empty()) in.open(file_path, std::ios::in | std::ios::binary);
+    std::string buf;
+    uint64_t m = 0;
+    while (m < misses.size()) {
+        /* Extend the read over the next missing blocks while the gap to them is small */
+        uint64_t j = m;
+        while (j + 1 < misses.size()) {
+            const BlockHandle &last = index[wanted[misses[j]]];
+            if (index[wanted[misses[j + 1]]].offset - (last.offset + last.size) > MULTIGET_READ_GAP) break;
+            ++j;
+        }
+        uint64_t start = index[wanted[misses[m]]].offset;
+        uint64_t end = index[wanted[misses[j]]].offset + index[wanted[misses[j]]].size;
+        buf.assign(end - start, '\0');
+        in.clear();
+        in.seekg(start, in.beg);
+        in.read(&buf[0], end - start);
+        bool isWhole = (uint64_t) in.gcount() == end - start;
+        for (; m <= j; ++m) {
+            uint64_t i = misses[m];
+            isRead[i] = isWhole && unpackBlock(wanted[i], buf.data() + (index[wanted[i]].offset - start), blocks[i]);
+        }
+    }
+
+    uint64_t loaded = none;                 //Block decoded into entries
+    uint64_t w = 0;                         //Its position in wanted
+    bool isWhole = true;                    //It was read and decoded to its end
+    std::vector<BlockEntry> entries;
+    for (uint64_t k = 0; k < num; ++k) {
+        if (blockOf[k] == none) continue;
+        if (blockOf[k] != loaded) {
+            loaded = blockOf[k];
+            while (wanted[w] != loaded) ++w;
+            isWhole = isRead[w] && decodeBlock(blocks[w].data, blocks[w].size, entries);
+        }
+        auto it = std::lower_bound(entries.begin(), entries.end(), keys[k],
+                                   [](const BlockEntry &e, uint64_t key) { return e.key < key; });
+        if (it != entries.end() && it->key == keys[k]) vals[k].assign(it->value, it->len);
+        else if (!isWhole) {
+            vals[k] = "~DELETE~";
+            ++unreadable;
+        }
+    }
+}
+
+/**
+ * @brief Read one value from disk.
+ * @param offset the postion of value in the file
+ * @param len the length of the value (0: the value reaches the end of file)
+ * @return value string
+ */
+std::string SSTable::readValue(uint32_t offset, uint32_t len)
+{
+    char *buf;
+    std::ifstream out;
+
+    /* Read in place from the mapping */
+    if (mapData) {
+        uint64_t end = (len == 0) ? mapSize : (uint64_t) offset + len;
+        if (offset > mapSize || end > mapSize) return "";
+        const char *val = mapData + offset;
+        return std::string(val, strnlen(val, end - offset));
+    }
+
+    out.open(file_path, std::ios::in | std::ios::binary);
+    out.seekg(offset, out.beg);
+    /* Value locate in the end of file */
+    if (len == 0) {
+        out.seekg(0, out.end);
+        uint64_t fileSize = out.tellg();
+        out.seekg(offset, out.beg);
+        buf = new char[fileSize - offset + 1];
+        out.read(buf, fileSize - offset);
+        buf[fileSize - offset] = '\0';
+    }
+    /* Read value according to len */
+    else {
+        buf = new char[len + 1];
+        out.read(buf, len);
+        buf[len] = '\0';
+    }
+    out.close();
+    std::string retStr = std::string(buf);
+    delete[] buf;
+    return retStr;
+}
+
 /**
  * Get offset and length of value according to key
  * @param key key to be searched.
@@ -98,10 +603,13 @@ std::string SSTable::get(uint64_t key)
  */
 bool SSTable::getOffSet(uint64_t key, uint32_t &offset, uint32_t &len)
 {
+    load();
     int sizeOfDic = dic.size();
     int left = 0;
     int right = sizeOfDic - 1;
-    int mid;
+    int mid = 0;
+    /* Empty dic: nothing to search */
+    if (sizeOfDic == 0) return false;
     /* Search: O(logn) */
     while (left <= right) {
         mid = (left + right) / 2;
@@ -122,36 +630,64 @@ bool SSTable::getOffSet(uint64_t key, uint32_t &offset, uint32_t &len)
     }
 }
 
+/**
+ * @brief Drop one reference. The last one deletes the SSTable, and its file too if it was marked obsolete.
+ */
+void SSTable::unref()
+{
+    if (--refs > 0) return;
+    if (isObsolete) reset();
+    delete this;
+}
+
 /**
  * @brief Clear the SSTable in cache and corresponding file in disk
  */
 void SSTable::reset()
 {
-    delete header;
-    delete bf;
+    utils::munmapFile(mapData, mapSize);
+    mapData = nullptr;
+    mapSize = 0;
     dic.clear();
+    index.clear();
     utils::rmfile(file_path.c_str());
 }
 
 SSInfo *SSTable::returnHeader()
 {
-    uint64_t timeStamp = header->timeStamp;
-    uint64_t  size = header->size;
-    uint64_t minKey = header->minKey;
-    uint64_t  maxKey = header->maxKey;
-    SSInfo *h = new SSInfo(timeStamp, size, minKey, maxKey);
-    return h;
+    return header;
 }
 
 /**
- * @brief Copy this.dic to d
- * @param dk Array which we copy this.dic to
+ * @brief Append every interval-th key of the dictionary to keys (ascending)
  */
-void SSTable::getDicKey(std::vector<uint64_t> &dk)
+void SSTable::sampleKeys(uint64_t interval, std::vector<uint64_t> &keys)
 {
-    uint64_t dicSize = dic.size();
-    for (int i = 0; i < dicSize; ++i) {
-        uint64_t key = dic[i].first;
-        dk.push_back(key);
+    load();
+    /* Block-based: the last keys of the blocks, about one per interval keys */
+    if (isBlockBased) {
+        uint64_t perBlock = index.empty() ? 1 : std::max<uint64_t>(1, header->size / index.size());
+        uint64_t stride = std::max<uint64_t>(1, interval / perBlock);
+        for (uint64_t b = 0; b < index.size(); b += stride)
+            keys.push_back(index[b].lastKey);
+        return;
+    }
+    for (uint64_t i = 0; i < dic.size(); i += interval)
+        keys.push_back(dic[i].first);
+}
+
+/**
+ * @brief Whether some value of the SSTable is "~DELETE~". v1: only the values of its length are read.
+ */
+bool SSTable::hasDeletes()
+{
+    load();
+    if (isBlockBased) return numDeletes > 0;
+    const uint32_t deleteLen = 8;
+    for (uint64_t i = 0; i < dic.size(); ++i) {
+        uint32_t len = (i + 1 < dic.size()) ? dic[i + 1].second - dic[i].second
+                                            : (uint32_t) (fileBytes - dic[i].second);
+        if (len == deleteLen && readValue(dic[i].second, len) == "~DELETE~") return true;
     }
+    return false;
 }
@@ -3,7 +3,18 @@
 #include <vector>
 
 #include "bloomfilter.h"
+#include "blockcache.h"
+#include "compression.h"
+#include "utils.h"
 #include <string>
+#include <atomic>
+#include <mutex>
+
+#define MULTIGET_READ_GAP 4096      //Values of one batch closer than this are read from disk together
+#define SSTABLE_BLOCK_SIZE 4096     //Block-based format: default bytes a data block is closed at (Options::blockSize)
+#define SSTABLE_FOOTER_SIZE 32      //Block-based format: filter offset, index offset, deletions, magic
+#define SSTABLE_MAGIC_V2 0x3230545353534C00ULL  //Block-based format: last 8 bytes of a v2 file, "\0LSSST02"
+#define SSTABLE_MAGIC_V3 0x3330545353534C00ULL  //Last 8 bytes of a v3 file, "\0LSSST03"
 
 struct SSInfo
 {
@@ -15,34 +26,133 @@ struct SSInfo
             : timeStamp(t), size(s), minKey(_min), maxKey(_max) {}
 };
 
+/**
+ * Where one data block of a block-based SSTable lies, the only per-block state kept in memory
+ */
+struct BlockHandle
+{
+    uint64_t lastKey;               //Biggest key of the block
+    uint64_t offset;
+    uint64_t size;                  //Bytes on disk
+    CompressionType type;
+    BlockHandle(uint64_t _lastKey, uint64_t _offset, uint64_t _size, CompressionType _type = COMPRESSION_NONE)
+            : lastKey(_lastKey), offset(_offset), size(_size), type(_type) {}
+};
+
+/**
+ * Uncompressed bytes of one data block, in the mapping, the cache or a buffer of their own
+ */
+struct BlockContents
+{
+    const char *data;
+    uint64_t size;
+    CacheHandle holder;             //Keeps data alive unless it points into the mapping
+};
+
+/**
+ * One K-V pair decoded from a data block; value points into the block
+ */
+struct BlockEntry
+{
+    uint64_t key;
+    const char *value;
+    uint64_t len;
+};
 
+/**
+ * One SSTable file, in either format:
+ * - v1: [header(32)][filter][key(8) offset(4) per pair][values]. The whole dictionary is kept in memory.
+ * - v2, block-based: [header(32)][data blocks][filter][index][footer(32)].
+ *   A data block holds varint(key - previous key in the block) varint(value length) value per pair; the first
+ *   key is stored whole. The index holds varint(numBlocks), then varint(lastKey - previous lastKey)
+ *   varint(size) per block, and is the only part kept in memory. The footer is
+ *   [filter offset(8)][index offset(8)][number of "~DELETE~" values(8)][SSTABLE_MAGIC_V2(8)].
+ * - v3: v2 with the codec of every block (see CompressionType) as one more varint of its index entry,
+ *   ending with SSTABLE_MAGIC_V3. The block size in the index is the size on disk.
+ * New files are written in v3; v1 and v2 files are still read.
+ * Opening a file reads its header at most: the filter and dic (v2: index) are loaded on first use.
+ */
 class SSTable
 {
+    friend class SSTableIterator;
+
 private:
     SSInfo *header;
     BloomFilter *bf;
-    std::vector<std::pair<uint64_t, uint32_t>> dic;
+    std::vector<std::pair<uint64_t, uint32_t>> dic;     //v1: every key and the offset of its value
+    bool isBlockBased;              //v2 or v3 file
+    std::vector<BlockHandle> index; //v2: every data block
+    uint64_t numDeletes;            //v2: "~DELETE~" values in the file
     std::string file_path;
+    uint64_t number;                //File number: the file is named "sstable<number>.sst"
+    uint64_t id;                    //Unique in this process, never reused (key of cached values)
+    BlockCache *cache;              //Shared value cache, nullptr if reads go straight to disk
+    const char *mapData;            //Whole file mapped read-only, nullptr if reads go through ifstream
+    uint64_t mapSize;
+    uint64_t fileBytes;             //Size of the file
+    std::atomic<int> refs;          //Holders: the level it belongs to, plus open iterators
+    std::atomic<bool> isObsolete;   //Delete the file when the last holder lets go
+    bool useMmap;                   //Map the file when it is loaded
+    std::atomic<bool> isLoaded;     //Filter and dic (v2: index) are in memory
+    bool isMetaCorrupt;             //Filter or dic (v2: index) could not be read: every lookup in range fails
+    std::mutex loadMutex;
+
+    void readHeader();
+
+    void loadMeta();
+
+    bool readMeta();
+
+    static uint64_t filterBytes(const char *head);
+
+    static uint64_t newId();
+
+    std::string readValue(uint32_t offset, uint32_t len);
+
+    static bool parseFooter(const char *footer, uint64_t size, uint64_t &filterOffset, uint64_t &indexOffset,
+                            uint64_t &deletes, bool &hasTypes);
+
+    bool parseIndex(const char *p, const char *limit, bool hasTypes);
+
+    uint64_t findBlock(uint64_t key, uint64_t from = 0);
+
+    bool readBlock(uint64_t b, BlockContents &block, bool fillCache = true);
+
+    bool unpackBlock(uint64_t b, const char *raw, BlockContents &block, bool fillCache = true);
+
+    void getSortedBlocks(const uint64_t *keys, uint64_t num, std::string *vals, uint64_t &unreadable);
 
 public:
-    SSTable(SSInfo *h, BloomFilter *b, const std::vector<std::pair<uint64_t, uint32_t>> &d, const std::string &p)
-            : header(h), bf(b), file_path(p) {
-        uint64_t size = d.size();
-        for (uint64_t i = 0; i < size; ++i) {
-            uint64_t key = d[i].first;
-            uint32_t offset = d[i].second;
-            dic.push_back(std::pair<uint64_t, uint32_t>(key, offset));
-        }
-    }
-    SSTable(const std::string &path);
+    SSTable(SSInfo *h, BloomFilter *b, const std::vector<BlockHandle> &_index, uint64_t _numDeletes,
+            const std::string &p, BlockCache *c = nullptr)
+            : header(h), bf(b), isBlockBased(true), index(_index), numDeletes(_numDeletes), file_path(p),
+              number(parseNumber(p)), id(newId()), cache(c), mapData(nullptr), mapSize(0),
+              fileBytes(utils::fileSize(p)), refs(1), isObsolete(false), useMmap(false), isLoaded(true),
+              isMetaCorrupt(false) {}
+    SSTable(const std::string &path, BlockCache *c = nullptr, bool _useMmap = false, SSInfo *h = nullptr);
 
     ~SSTable(){
+        utils::munmapFile(mapData, mapSize);
         delete header;
         delete bf;
         dic.clear();
+        index.clear();
     }
 
-    std::string get(uint64_t key);
+    void ref(){++refs;}
+
+    void unref();
+
+    void markObsolete(){isObsolete = true;}
+
+    /**
+     * @brief Load the filter and dic (v2: index) unless that is done; every reader of them calls this first
+     */
+    void load(){if (!isLoaded.load(std::memory_order_acquire)) loadMeta();}
+
+    std::string get(uint64_t key, bool &isCorrupt, bool fillCache = true);
+
+    void getSorted(const uint64_t *keys, uint64_t num, std::string *vals, uint64_t &unreadable);
 
     bool getOffSet(uint64_t key, uint32_t &offset, uint32_t &len);
 
@@ -50,9 +160,29 @@ public:
 
     SSInfo *returnHeader();
 
+    uint64_t fileSize(){return fileBytes;}
+
+    void sampleKeys(uint64_t interval, std::vector<uint64_t> &keys);
+
+    bool hasDeletes();
+
+    static bool decodeBlock(const char *data, uint64_t size, std::vector<BlockEntry> &entries);
+
     std::string returnPath(){return file_path;}
 
-    void getDicKey(std::vector<uint64_t> &dk);
+    uint64_t returnId(){return id;}
+
+    uint64_t returnNumber(){return number;}
+
+    static std::string fileName(uint64_t number){return "sstable" + std::to_string(number) + ".sst";}
+
+    static uint64_t parseNumber(const std::string &path);
+
+    bool mapFile();
+
+    bool isMapped(){return mapData != nullptr;}
+
+    void advise(utils::MapAdvice advice){utils::madviseFile(mapData, mapSize, advice);}
 };
 
 
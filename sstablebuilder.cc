@@ -0,0 +1,156 @@
+#include <cstring>
+
+#include "sstablebuilder.h"
+#include "utils.h"
+#include "coding.h"
+
+/**
+ * @brief Append a K-V pair whose value stays where it is until finish(), e.g. in a MemTable node. Unless blocks are
+ *        compressed, a long value is then written to the file straight from there instead of being copied.
+ */
+void SSTableBuilder::addRef(uint64_t key, const char *val, uint64_t len)
+{
+    append(key, val, len, compression == COMPRESSION_NONE && len >= BUILDER_MIN_REF_BYTES);
+}
+
+/**
+ * @brief Append a K-V pair. key must be bigger than every key added before.
+ * @param byRef keep a pointer to val instead of copying it (only for raw blocks)
+ */
+void SSTableBuilder::append(uint64_t key, const char *val, uint64_t len, bool byRef)
+{
+    if (dataBytes - blockStart >= blockSize) finishBlock();
+    /* The first key of a block is stored whole, the others as the distance to the key before */
+    uint64_t prevKey = (dataBytes == blockStart) ? 0 : keys.back();
+    uint64_t before = blocks.size();
+    coding::putVarint64(blocks, key - prevKey);
+    coding::putVarint64(blocks, len);
+    if (byRef) {
+        chunks.push_back(std::pair<const char *, uint64_t>(nullptr, blocks.size() - chunkedBytes));
+        chunks.push_back(std::pair<const char *, uint64_t>(val, len));
+        chunkedBytes = blocks.size();
+    }
+    else blocks.append(val, len);
+    dataBytes += blocks.size() - before + (byRef ? len : 0);
+    keys.push_back(key);
+    if (len == 8 && memcmp(val, "~DELETE~", 8) == 0) ++numDeletes;
+}
+
+/**
+ * @brief Close the open block, compressing it, and add it to the index
+ */
+void SSTableBuilder::finishBlock()
+{
+    CompressionType type = COMPRESSION_NONE;
+    uint64_t rawSize = dataBytes - blockStart;
+    /* Nothing is referenced when blocks are compressed, so the block lies in blocks as a whole */
+    if (compression == COMPRESSION_LZ) {
+        std::string compressed;
+        compression::lzCompress(blocks.data() + blockStart, rawSize, compressed);
+        if (compressed.size() < rawSize - rawSize / 8) {
+            blocks.resize(blockStart);
+            blocks.append(compressed);
+            dataBytes = blocks.size();
+            type = COMPRESSION_LZ;
+        }
+    }
+    index.push_back(BlockHandle(keys.back(), 32 + blockStart, dataBytes - blockStart, type));
+    blockStart = dataBytes;
+}
+
+/**
+ * @return Size of the file finish() would write now, before compression (the index is estimated)
+ */
+uint64_t SSTableBuilder::fileSize()
+{
+    return 32 + dataBytes + BloomFilter::sectionSize(keys.size(), bitsPerKey) + 10 + 15 * (index.size() + 1)
+           + SSTABLE_FOOTER_SIZE;
+}
+
+/**
+ * @return Size of the file after adding one more pair with value val (estimated like fileSize)
+ */
+uint64_t SSTableBuilder::sizeAfterAdd(const std::string &val)
+{
+    uint64_t n = keys.size() + 1;
+    return 32 + dataBytes + 20 + val.length() + BloomFilter::sectionSize(n, bitsPerKey)
+           + 10 + 15 * (index.size() + 2) + SSTABLE_FOOTER_SIZE;
+}
+
+/**
+ * @brief Write the SSTable to filePath, sync it, and reset the builder for the next file. The file only shows up
+ *        under filePath once it is complete.
+ * @param timeStamp timeStamp in the header
+ * @return The SSTable of the new file, nullptr if it could not be written (then no file is left behind)
+ */
+SSTable *SSTableBuilder::finish(uint64_t timeStamp, const std::string &filePath, BlockCache *cache, bool useMmap)
+{
+    if (dataBytes > blockStart) finishBlock();
+    uint64_t num = keys.size();
+    SSInfo *header = new SSInfo(timeStamp, num, num ? keys.front() : 0, num ? keys.back() : 0);
+    BloomFilter *bf = new BloomFilter(num, bitsPerKey);
+    for (uint64_t key : keys)
+        bf->insert(key);
+
+    /* Filter, index and footer follow the data blocks */
+    uint64_t filterOffset = 32 + dataBytes;
+    std::string meta(bf->sectionSize(), '\0');
+    bf->serialize(&meta[0]);
+    uint64_t indexOffset = filterOffset + meta.size();
+    coding::putVarint64(meta, index.size());
+    uint64_t lastKey = 0;
+    for (const BlockHandle &h : index) {
+        coding::putVarint64(meta, h.lastKey - lastKey);
+        coding::putVarint64(meta, h.size);
+        coding::putVarint64(meta, h.type);
+        lastKey = h.lastKey;
+    }
+    coding::putFixed64(meta, filterOffset);
+    coding::putFixed64(meta, indexOffset);
+    coding::putFixed64(meta, numDeletes);
+    coding::putFixed64(meta, SSTABLE_MAGIC_V3);
+
+    /* Write SSTable to disk: header, the copied and the referenced parts of the data blocks, then the rest */
+    std::vector<std::pair<const char *, uint64_t>> bufs;
+    bufs.push_back(std::pair<const char *, uint64_t>((const char *) header, 32));
+    const char *owned = blocks.data();
+    for (const std::pair<const char *, uint64_t> &chunk : chunks) {
+        bufs.push_back(std::pair<const char *, uint64_t>(chunk.first ? chunk.first : owned, chunk.second));
+        if (!chunk.first) owned += chunk.second;
+    }
+    bufs.push_back(std::pair<const char *, uint64_t>(owned, blocks.data() + blocks.size() - owned));
+    bufs.push_back(std::pair<const char *, uint64_t>(meta.data(), meta.size()));
+    /* The MANIFEST will refer to this file, so it has to be on disk, under its name, first */
+    std::string tmpPath = filePath + ".tmp";
+    size_t slash = filePath.rfind('/');
+    std::string dirPath = (slash == std::string::npos) ? "." : filePath.substr(0, slash);
+    int fd = utils::openAppend(tmpPath.c_str(), true);
+    bool isWritten = fd >= 0 && utils::writeAllv(fd, bufs) == 0 && utils::syncFile(fd) == 0;
+    if (fd >= 0 && utils::closeFile(fd) != 0) isWritten = false;
+    if (isWritten && utils::renameFile(tmpPath.c_str(), filePath.c_str()) != 0) isWritten = false;
+    if (isWritten && utils::syncDir(dirPath.c_str()) != 0) {
+        utils::rmfile(filePath.c_str());
+        isWritten = false;
+    }
+
+    SSTable *st = nullptr;
+    if (isWritten) {
+        st = new SSTable(header, bf, index, numDeletes, filePath, cache);
+        if (useMmap) st->mapFile();
+    }
+    else {
+        if (fd >= 0) utils::rmfile(tmpPath.c_str());
+        delete header;
+        delete bf;
+    }
+
+    keys.clear();
+    blocks.clear();
+    chunks.clear();
+    chunkedBytes = 0;
+    dataBytes = 0;
+    blockStart = 0;
+    index.clear();
+    numDeletes = 0;
+    return st;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "sstable.h"
+#include "compression.h"
+
+#define BUILDER_MIN_REF_BYTES 256       //addRef: shorter values are copied, gathering them would cost more than that
+
+/**
+ * Builds one block-based SSTable from K-V pairs added in ascending key order, without a MemTable in between.
+ * Pairs are encoded into data blocks as they come, and every block is compressed when it is closed
+ * (kept raw if that does not save an eighth of it); finish() appends filter, index and footer
+ * and writes the file with one gathered write into a temporary file, which is synced and renamed into place.
+ */
+class SSTableBuilder
+{
+private:
+    int bitsPerKey;
+    CompressionType compression;            //Codec tried on every block
+    uint64_t blockSize;                     //A block is closed once it holds this many bytes
+    std::vector<uint64_t> keys;             //For the filter, built once their number is known
+    std::string blocks;                     //Encoded (closed ones: compressed) data blocks, laid out after the header
+    /* The data blocks in file order once a value is referenced instead of copied:
+     * (nullptr, n) stands for the next n bytes of blocks */
+    std::vector<std::pair<const char *, uint64_t>> chunks;
+    uint64_t chunkedBytes;                  //Bytes of blocks already in chunks
+    uint64_t dataBytes;                     //Bytes of the data blocks, copied and referenced
+    uint64_t blockStart;                    //Offset of the open block inside the data blocks
+    std::vector<BlockHandle> index;         //Closed blocks
+    uint64_t numDeletes;
+
+    void append(uint64_t key, const char *val, uint64_t len, bool byRef);
+
+    void finishBlock();
+
+public:
+    SSTableBuilder(int _bitsPerKey = BITS_PER_KEY, CompressionType _compression = COMPRESSION_NONE,
+                   uint64_t _blockSize = SSTABLE_BLOCK_SIZE)
+            : bitsPerKey(_bitsPerKey), compression(_compression), blockSize(_blockSize), chunkedBytes(0),
+              dataBytes(0), blockStart(0), numDeletes(0) {}
+
+    void add(uint64_t key, const std::string &val){append(key, val.data(), val.size(), false);}
+
+    void add(uint64_t key, const char *val, uint64_t len){append(key, val, len, false);}
+
+    void addRef(uint64_t key, const char *val, uint64_t len);
+
+    uint64_t fileSize();
+
+    uint64_t sizeAfterAdd(const std::string &val);
+
+    uint64_t numEntries(){return keys.size();}
+
+    bool isEmpty(){return keys.empty();}
+
+    SSTable *finish(uint64_t timeStamp, const std::string &filePath, BlockCache *cache = nullptr, bool useMmap = false);
+};
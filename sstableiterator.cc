@@ -0,0 +1,253 @@
+#include <cstring>
+#include <algorithm>
+
+#include "sstableiterator.h"
+#include "compression.h"
+
+/**
+ * @brief Open a cursor standing on the first K-V pair of _st.
+ */
+SSTableIterator::SSTableIterator(SSTable *_st)
+        : st(_st), index(0), block(0), loadedBlock(UINT64_MAX), fileSize(0), buf(nullptr), isBackward(false),
+          bufStart(0), bufLen(0), isLoaded(false), isCorrupt(false)
+{
+    st->load();
+    /* A table whose filter or index could not be read looks empty: say so, or it would pass for one */
+    isCorrupt = st->isMetaCorrupt;
+    if (st->mapData) fileSize = st->mapSize;
+}
+
+SSTableIterator::~SSTableIterator()
+{
+    delete[] buf;
+}
+
+bool SSTableIterator::valid()
+{
+    if (st->isBlockBased) {
+        /* The first block is read on first use */
+        if (block != loadedBlock) loadBlock();
+        return block < st->index.size() && index < entries.size();
+    }
+    return index < st->dic.size();
+}
+
+uint64_t SSTableIterator::key()
+{
+    if (!st->isBlockBased) return st->dic[index].first;
+    if (block != loadedBlock) loadBlock();
+    return entries[index].key;
+}
+
+void SSTableIterator::seekToFirst()
+{
+    isLoaded = false;
+    isBackward = false;
+    if (st->isBlockBased) moveTo(0, false);
+    else index = 0;
+}
+
+void SSTableIterator::seekToLast()
+{
+    isLoaded = false;
+    isBackward = true;
+    if (st->isBlockBased) moveTo(st->index.empty() ? 0 : st->index.size() - 1, true);
+    else index = st->dic.empty() ? 0 : st->dic.size() - 1;
+}
+
+/**
+ * @brief Move to the first K-V pair whose key >= key. O(logn)
+ */
+void SSTableIterator::seek(uint64_t key)
+{
+    isLoaded = false;
+    isBackward = false;
+    if (st->isBlockBased) {
+        moveTo(st->findBlock(key), false);
+        index = std::lower_bound(entries.begin(), entries.end(), key,
+                                 [](const BlockEntry &e, uint64_t k) { return e.key < k; }) - entries.begin();
+        return;
+    }
+    uint64_t left = 0;
+    uint64_t right = st->dic.size();
+    while (left < right) {
+        uint64_t mid = (left + right) / 2;
+        if (st->dic[mid].first < key) left = mid + 1;
+        else right = mid;
+    }
+    index = left;
+}
+
+/**
+ * @brief Move to the last K-V pair whose key <= key. O(logn)
+ */
+void SSTableIterator::seekForPrev(uint64_t key)
+{
+    isLoaded = false;
+    isBackward = true;
+    if (st->isBlockBased) {
+        /* The block that may hold key, or the last one if every key is smaller */
+        uint64_t b = st->findBlock(key);
+        if (b == st->index.size()) {
+            seekToLast();
+            return;
+        }
+        moveTo(b, false);
+        uint64_t upper = std::upper_bound(entries.begin(), entries.end(), key,
+                                          [](uint64_t k, const BlockEntry &e) { return k < e.key; }) - entries.begin();
+        if (upper > 0) index = upper - 1;
+        else moveTo(b == 0 ? st->index.size() : b - 1, true);
+        return;
+    }
+    uint64_t left = 0;
+    uint64_t right = st->dic.size();
+    /* Find the first key > key, the pair before it is the answer */
+    while (left < right) {
+        uint64_t mid = (left + right) / 2;
+        if (st->dic[mid].first <= key) left = mid + 1;
+        else right = mid;
+    }
+    index = (left == 0) ? st->dic.size() : left - 1;
+}
+
+void SSTableIterator::next()
+{
+    isLoaded = false;
+    isBackward = false;
+    ++index;
+    if (st->isBlockBased && index >= entries.size()) moveTo(block + 1, false);
+}
+
+/**
+ * @brief Move to the previous K-V pair; before the first one the iterator is no longer valid.
+ */
+void SSTableIterator::prev()
+{
+    isLoaded = false;
+    isBackward = true;
+    if (st->isBlockBased) {
+        if (index > 0) --index;
+        else moveTo(block == 0 ? st->index.size() : block - 1, true);
+        return;
+    }
+    index = (index == 0) ? st->dic.size() : index - 1;
+}
+
+/**
+ * @return The value at the cursor ("~DELETE~" for a deletion)
+ */
+const std::string &SSTableIterator::value()
+{
+    if (!isLoaded) {
+        if (st->isBlockBased) {
+            if (block != loadedBlock) loadBlock();
+            val.assign(entries[index].value, entries[index].len);
+        }
+        else load();
+        isLoaded = true;
+    }
+    return val;
+}
+
+/**
+ * @brief v2: stand on the first (isLast: the last) pair of block b; b = st->index.size() leaves the iterator invalid.
+ */
+void SSTableIterator::moveTo(uint64_t b, bool isLast)
+{
+    block = b;
+    loadBlock();
+    index = (isLast && !entries.empty()) ? entries.size() - 1 : 0;
+}
+
+/**
+ * @brief v2: decode the current block into entries, unless it already is.
+ *        A cached block is used as it is; the iterator does not add the blocks it reads (and decompresses) to the cache.
+ *        A block that is cut short or does not decode sets isCorrupt; entries keeps the pairs before the damage.
+ */
+void SSTableIterator::loadBlock()
+{
+    if (block >= st->index.size()) {
+        entries.clear();
+        loadedBlock = UINT64_MAX;
+        return;
+    }
+    if (block == loadedBlock) return;
+    const BlockHandle &h = st->index[block];
+    loadedBlock = block;
+    contents.holder.reset();
+    if ((!st->mapData || h.type != COMPRESSION_NONE) && st->cache)
+        contents.holder = st->cache->lookup(st->id, h.offset);
+    if (contents.holder) {
+        contents.data = contents.holder->data();
+        contents.size = contents.holder->size();
+    }
+    else {
+        contents.data = fetch(h.offset, h.offset + h.size);
+        contents.size = h.offset + h.size <= fileSize ? h.size : 0;
+        if (contents.size != h.size) isCorrupt = true;
+        if (h.type != COMPRESSION_NONE) {
+            if (!compression::uncompress(h.type, contents.data, contents.size, blockBuf)) {
+                blockBuf.clear();
+                isCorrupt = true;
+            }
+            contents.data = blockBuf.data();
+            contents.size = blockBuf.size();
+        }
+    }
+    if (!SSTable::decodeBlock(contents.data, contents.size, entries)) isCorrupt = true;
+}
+
+/**
+ * @brief Bytes [start, end) of the file, valid until the next fetch. Opens the file on first use:
+ *        a scan may position many iterators and read few of them.
+ */
+const char *SSTableIterator::fetch(uint64_t start, uint64_t end)
+{
+    if (!st->mapData && buf == nullptr) {
+        in.open(st->file_path, std::ios::in | std::ios::binary);
+        in.seekg(0, in.end);
+        fileSize = in ? (uint64_t) in.tellg() : 0;
+        if (!in) isCorrupt = true;
+        buf = new char[ITER_BUFFER_SIZE];
+    }
+    if (end > fileSize) end = fileSize;
+    if (start > end) start = end;
+    if (st->mapData) return st->mapData + start;
+
+    /* Refill: the buffer holds this range and as many of its neighbours in the direction of travel as fit */
+    if (start < bufStart || end > bufStart + bufLen) {
+        uint64_t want = end - start;
+        if (want > ITER_BUFFER_SIZE) {
+            spill.assign(want, '\0');
+            in.clear();
+            in.seekg(start, in.beg);
+            in.read(&spill[0], want);
+            if ((uint64_t) in.gcount() != want) isCorrupt = true;
+            return spill.data();
+        }
+        /* Going forward the buffer starts at this range, going backward it ends with it */
+        if (isBackward) bufStart = (end > ITER_BUFFER_SIZE) ? end - ITER_BUFFER_SIZE : 0;
+        else bufStart = start;
+        bufLen = fileSize - bufStart < ITER_BUFFER_SIZE ? fileSize - bufStart : ITER_BUFFER_SIZE;
+        in.clear();
+        in.seekg(bufStart, in.beg);
+        in.read(buf, bufLen);
+        if ((uint64_t) in.gcount() != bufLen) isCorrupt = true;
+    }
+    return buf + (start - bufStart);
+}
+
+/**
+ * @brief v1: read the value at index: [its offset, the next offset), the last one runs to the end of the file.
+ *        Like SSTable::get, the value ends at its first '\0'.
+ */
+void SSTableIterator::load()
+{
+    uint64_t start = st->dic[index].second;
+    uint64_t end = (index + 1 < st->dic.size()) ? st->dic[index + 1].second : UINT64_MAX;
+    const char *p = fetch(start, end);
+    /* fetch clipped the range to the file */
+    if (end > fileSize) end = fileSize;
+    if (start > end) start = end;
+    val.assign(p, strnlen(p, end - start));
+}
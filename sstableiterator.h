@@ -0,0 +1,75 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "sstable.h"
+#include "iterator.h"
+
+#define ITER_BUFFER_SIZE (256 * 1024)       //Bytes of the value region read from disk at a time
+
+/**
+ * Sequential cursor over the K-V pairs of one SSTable, in key order.
+ * v1: keys come from the dictionary in memory. v2: the current data block is decoded as a whole, cached
+ * blocks are used in place. Bytes are read in place from the mapping, or from the file through a buffer
+ * that is refilled in ITER_BUFFER_SIZE chunks, so a full pass reads the file once, front to back.
+ * The file is opened on the first read. The SSTable must outlive the iterator.
+ */
+class SSTableIterator : public Iterator
+{
+private:
+    SSTable *st;
+    uint64_t index;                 //Position in the dictionary (v2: in entries)
+    uint64_t block;                 //v2: current data block, st->index.size() if not valid
+    uint64_t loadedBlock;           //v2: block decoded into entries
+    BlockContents contents;         //v2: bytes of loadedBlock
+    std::string blockBuf;           //v2: loadedBlock decompressed, unless it came from the cache
+    std::vector<BlockEntry> entries;        //v2: pairs of loadedBlock
+    uint64_t fileSize;
+    std::ifstream in;               //Unused if st is mapped
+    char *buf;
+    bool isBackward;                //Last move was prev(): refill the buffer with the bytes before the cursor
+    uint64_t bufStart;              //File offset of buf[0]
+    uint64_t bufLen;
+    std::string spill;              //Ranges bigger than buf
+    std::string val;
+    bool isLoaded;                  //val holds the value at index
+    bool isCorrupt;                 //A read came up short or a block could not be decoded
+
+    const char *fetch(uint64_t start, uint64_t end);
+
+    void load();
+
+    void loadBlock();
+
+    void moveTo(uint64_t b, bool isLast);
+
+public:
+    SSTableIterator(SSTable *_st);
+
+    ~SSTableIterator();
+
+    bool valid() override;
+
+    void seekToFirst() override;
+
+    void seekToLast() override;
+
+    void seek(uint64_t key) override;
+
+    void seekForPrev(uint64_t key) override;
+
+    void next() override;
+
+    void prev() override;
+
+    uint64_t key() override;
+
+    const std::string &value() override;
+
+    bool hasError() override {return isCorrupt;}
+
+    uint64_t timeStamp(){return st->header->timeStamp;}
+};
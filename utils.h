@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <sstream>
 #include <sys/stat.h>
 #include <vector>
@@ -9,6 +11,7 @@
 #include <direct.h>
 #include <stdio.h>
 #include <io.h>
+#include <fcntl.h>
 #include <windows.h>
 #endif
 #if defined(__linux__) || defined(__MINGW32__) || defined(__APPLE__)
@@ -16,6 +19,12 @@
 #include <unistd.h>
 #include <cstring>
 #endif
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
 
 namespace utils{
     /**
@@ -98,11 +107,12 @@ namespace utils{
      * @return 0 if directory is created successfully, -1 otherwise.
      */
     static inline int mkdir(const char *path){
-        std::string currentPath = "";
+        std::string currentPath = (path[0] == '/') ? "/" : "";
         std::string dirName;
         std::stringstream ss(path);
 
         while (std::getline(ss, dirName, '/')){
+            if (dirName.empty()) continue;
             currentPath += dirName;
             if (!dirExists(currentPath) && _mkdir(currentPath.c_str()) != 0){
                 return -1;
@@ -138,6 +148,249 @@ namespace utils{
         #endif
     }
 
+    /**
+     * Check whether file exists
+     * @param path file to be checked.
+     * @return true if a regular file exists, false otherwise.
+     */
+    static inline bool fileExists(std::string path){
+        struct stat st;
+        int ret = stat(path.c_str(), &st);
+        return ret == 0 && (st.st_mode & S_IFREG);
+    }
+
+    /**
+     * Size of a file
+     * @param path file to be checked.
+     * @return size in bytes, 0 if it can not be read.
+     */
+    static inline uint64_t fileSize(std::string path){
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return 0;
+        return (uint64_t) st.st_size;
+    }
+
+    /**
+     * Open a file for appending, create it if it does not exist
+     * @param path file to be opened.
+     * @param truncate drop the old content of the file.
+     * @return file descriptor, -1 on failure.
+     */
+    static inline int openAppend(const char *path, bool truncate = false){
+        #ifdef _WIN32
+            int flags = _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (truncate ? _O_TRUNC : 0);
+            return ::_open(path, flags, _S_IREAD | _S_IWRITE);
+        #else
+            int flags = O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0);
+            return ::open(path, flags, 0644);
+        #endif
+    }
+
+    /**
+     * Write the whole buffer to fd
+     * @return 0 if all bytes are written, -1 otherwise.
+     */
+    static inline int writeAll(int fd, const char *buf, uint64_t len){
+        while (len > 0) {
+            #ifdef _WIN32
+                int n = ::_write(fd, buf, (unsigned int) len);
+            #else
+                ssize_t n = ::write(fd, buf, len);
+            #endif
+            if (n <= 0) return -1;
+            buf += n;
+            len -= n;
+        }
+        return 0;
+    }
+
+    /**
+     * Write several buffers to fd one after another, gathered into as few calls as possible
+     * @param bufs start and length of every buffer.
+     * @return 0 if all bytes are written, -1 otherwise.
+     */
+    static inline int writeAllv(int fd, const std::vector<std::pair<const char *, uint64_t>> &bufs){
+        #if defined(__linux__) || defined(__APPLE__)
+            #ifdef IOV_MAX
+                const uint64_t maxIov = IOV_MAX;
+            #else
+                const uint64_t maxIov = 1024;
+            #endif
+            std::vector<struct iovec> iov;
+            for (const std::pair<const char *, uint64_t> &buf : bufs) {
+                if (buf.second > 0) iov.push_back(iovec{(void *) buf.first, (size_t) buf.second});
+            }
+            uint64_t first = 0;
+            while (first < iov.size()) {
+                uint64_t num = (iov.size() - first < maxIov) ? iov.size() - first : maxIov;
+                ssize_t n = ::writev(fd, iov.data() + first, (int) num);
+                if (n <= 0) return -1;
+                /* Skip what was written, a partly written buffer continues where it stopped */
+                while (first < iov.size() && (size_t) n >= iov[first].iov_len) {
+                    n -= iov[first].iov_len;
+                    ++first;
+                }
+                if (n > 0) {
+                    iov[first].iov_base = (char *) iov[first].iov_base + n;
+                    iov[first].iov_len -= n;
+                }
+            }
+            return 0;
+        #else
+            for (const std::pair<const char *, uint64_t> &buf : bufs) {
+                if (writeAll(fd, buf.first, buf.second) != 0) return -1;
+            }
+            return 0;
+        #endif
+    }
+
+    /**
+     * Flush the file content of fd to disk
+     * @return 0 if synced, -1 otherwise.
+     */
+    static inline int syncFile(int fd){
+        #ifdef _WIN32
+            return ::_commit(fd);
+        #elif defined(__linux__)
+            return ::fdatasync(fd);
+        #else
+            return ::fsync(fd);
+        #endif
+    }
+
+    /**
+     * Cut the file of fd down to size bytes
+     * @return 0 if truncated, -1 otherwise.
+     */
+    static inline int truncateFile(int fd, uint64_t size){
+        #ifdef _WIN32
+            return ::_chsize_s(fd, (__int64) size) == 0 ? 0 : -1;
+        #else
+            return ::ftruncate(fd, (off_t) size);
+        #endif
+    }
+
+    /**
+     * Flush the entries of a directory to disk, so a file created or renamed in it survives a crash
+     * @return 0 if synced (or not supported), -1 otherwise.
+     */
+    static inline int syncDir(const char *path){
+        #ifdef _WIN32
+            return 0;
+        #else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) return -1;
+            int ret = ::fsync(fd);
+            ::close(fd);
+            return ret;
+        #endif
+    }
+
+    static inline int closeFile(int fd){
+        #ifdef _WIN32
+            return ::_close(fd);
+        #else
+            return ::close(fd);
+        #endif
+    }
+
+    /**
+     * Rename a file, replacing the target if it exists
+     * @return 0 if renamed successfully, -1 otherwise.
+     */
+    static inline int renameFile(const char *from, const char *to){
+        #ifdef _WIN32
+            return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+        #else
+            return ::rename(from, to);
+        #endif
+    }
+
+    /**
+     * Give a file a second name (hard link); the data stays until both names are removed
+     * @return 0 if linked successfully, -1 otherwise.
+     */
+    static inline int linkFile(const char *from, const char *to){
+        #ifdef _WIN32
+            return CreateHardLinkA(to, from, NULL) ? 0 : -1;
+        #else
+            return ::link(from, to);
+        #endif
+    }
+
+    /**
+     * Read a whole file
+     * @param path file to be read.
+     * @param content set to the file content.
+     * @return 0 if read successfully, -1 otherwise.
+     */
+    static inline int readFile(const char *path, std::string &content){
+        content.clear();
+        FILE *f = fopen(path, "rb");
+        if (!f) return -1;
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            content.append(buf, n);
+        fclose(f);
+        return 0;
+    }
+
+    enum MapAdvice
+    {
+        MAP_RANDOM = 1,
+        MAP_SEQUENTIAL
+    };
+
+    /**
+     * Map a whole file read-only into memory
+     * @param path file to be mapped.
+     * @param size set to the file size.
+     * @return start of the mapping, nullptr if the file can not be mapped (or mmap is not supported).
+     */
+    static inline const char *mmapFile(const char *path, uint64_t &size){
+        size = 0;
+        #if defined(__linux__) || defined(__APPLE__)
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) return nullptr;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return nullptr;
+            }
+            void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED) return nullptr;
+            size = st.st_size;
+            return (const char *) addr;
+        #else
+            return nullptr;
+        #endif
+    }
+
+    /**
+     * Unmap a file mapped by mmapFile
+     * @param addr start of the mapping.
+     * @param size size of the mapping.
+     */
+    static inline void munmapFile(const char *addr, uint64_t size){
+        #if defined(__linux__) || defined(__APPLE__)
+            if (addr) ::munmap((void *) addr, size);
+        #endif
+    }
+
+    /**
+     * Tell the kernel how a mapping is going to be read
+     * @param addr start of the mapping.
+     * @param size size of the mapping.
+     * @param advice MAP_RANDOM for point lookups, MAP_SEQUENTIAL for whole-file reads.
+     */
+    static inline void madviseFile(const char *addr, uint64_t size, MapAdvice advice){
+        #if defined(__linux__) || defined(__APPLE__)
+            if (addr) ::madvise((void *) addr, size, advice == MAP_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+        #endif
+    }
+
 
     
 }
@@ -0,0 +1,81 @@
+#include "version.h"
+
+/**
+ * @brief Snapshot _mem, _imm and _levels, taking a reference on each of them
+ */
+Version::Version(MemTable *_mem, MemTable *_imm, const std::vector<std::vector<SSTable *>> &_levels)
+        : refs(1), mem(_mem), imm(_imm), levels(_levels)
+{
+    mem->ref();
+    if (imm != nullptr) imm->ref();
+    for (std::vector<SSTable *> &tables : levels) {
+        for (SSTable *st : tables)
+            st->ref();
+    }
+}
+
+Version::~Version()
+{
+    mem->unref();
+    if (imm != nullptr) imm->unref();
+    for (std::vector<SSTable *> &tables : levels) {
+        for (SSTable *st : tables)
+            st->unref();
+    }
+}
+
+/**
+ * @brief Find the only SSTable of levels[level] (level > 0) whose key range may hold key. O(logn)
+ * @return nullptr if no SSTable covers key
+ */
+SSTable *Version::findTable(int level, uint64_t key)
+{
+    std::vector<SSTable *> &tables = levels[level];
+    int left = 0;
+    int right = (int) tables.size() - 1;
+    /* Find the first SSTable whose maxKey >= key */
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (tables[mid]->returnHeader()->maxKey < key) left = mid + 1;
+        else right = mid;
+    }
+    if (tables.empty()) return nullptr;
+    SSInfo *h = tables[left]->returnHeader();
+    if (h->minKey <= key && key <= h->maxKey) return tables[left];
+    return nullptr;
+}
+
+/**
+ * @brief Search key from the newest source to the oldest; the first hit (value or "~DELETE~") decides.
+ * @param sequence the MemTables are read as of this write (the SSTables hold only earlier ones)
+ * @param probes increased by the number of SSTables searched
+ * @param isCorrupt set if the search stopped at an SSTable that could not be read: older ones may hold a stale value
+ * @return value string if found, "~DELETE~" if deleted, "" else.
+ */
+std::string Version::get(uint64_t key, uint64_t sequence, uint64_t &probes, bool &isCorrupt)
+{
+    isCorrupt = false;
+    std::string val;
+    if (mem->find(key, val, sequence)) return val;
+    if (imm != nullptr && imm->find(key, val, sequence)) return val;
+
+    for (uint64_t level = 0; level < levels.size(); ++level) {
+        /* Level0: files may overlap, try them from newest to oldest */
+        if (level == 0) {
+            for (SSTable *st : levels[0]) {
+                ++probes;
+                val = st->get(key, isCorrupt);
+                if (val != "" || isCorrupt) return val;
+            }
+        }
+        /* Other levels: at most one file covers key */
+        else {
+            SSTable *st = findTable(level, key);
+            if (st == nullptr) continue;
+            ++probes;
+            val = st->get(key, isCorrupt);
+            if (val != "" || isCorrupt) return val;
+        }
+    }
+    return "";
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "memtable.h"
+#include "sstable.h"
+
+/**
+ * Snapshot of everything a read looks at: MemTable, imm and the SSTables of every level.
+ * KVStore installs a new Version whenever one of them changes and never changes one in place, so a reader
+ * holding a Version searches it without any lock while flushes and compactions go on.
+ * A Version refs what it lists: an SSTable compacted away is deleted once the last Version holding it is released.
+ */
+class Version
+{
+private:
+    std::atomic<int> refs;          //Holders: KVStore while it is current, plus readers
+
+    ~Version();
+
+public:
+    MemTable *mem;
+    MemTable *imm;                  //nullptr if none
+    std::vector<std::vector<SSTable *>> levels;     //Same order as KVStore::levels
+
+    Version(MemTable *_mem, MemTable *_imm, const std::vector<std::vector<SSTable *>> &_levels);
+
+    void ref(){++refs;}
+
+    void unref(){if (--refs == 0) delete this;}
+
+    SSTable *findTable(int level, uint64_t key);
+
+    std::string get(uint64_t key, uint64_t sequence, uint64_t &probes, bool &isCorrupt);
+};
@@ -0,0 +1,166 @@
+#include <cstdlib>
+
+#include "wal.h"
+#include "coding.h"
+#include "utils.h"
+
+/**
+ * @param sequence the records of this log are numbered from sequence + 1
+ */
+WAL::WAL(const std::string &path, WALSyncMode _mode, uint64_t sequence)
+        : fileBytes(0), mode(_mode), lastSequence(sequence)
+{
+    fd = utils::openAppend(path.c_str(), true);
+}
+
+WAL::~WAL()
+{
+    if (fd >= 0) utils::closeFile(fd);
+}
+
+/**
+ * @brief Write data to the log and sync it if asked. lock is not held.
+ *        On failure, what part of data got in is cut off again: replay stops at the first bad record, so
+ *        records written behind it would be lost. If even that fails, nothing more is written to the log.
+ */
+bool WAL::writeGroup(const std::string &data, bool sync)
+{
+    if (fd < 0) return false;
+    if (utils::writeAll(fd, data.data(), data.size()) == 0 && (!sync || utils::syncFile(fd) == 0)) {
+        fileBytes += data.size();
+        return true;
+    }
+    if (utils::truncateFile(fd, fileBytes) != 0) {
+        utils::closeFile(fd);
+        fd = -1;
+    }
+    return false;
+}
+
+/**
+ * @brief Append one record. Returns once it is as durable as the sync mode promises.
+ *        SYNC_GROUP: the first waiting writer becomes the leader, writes the records of every writer queued
+ *        behind it and syncs once; the others sleep until the leader marks them done.
+ * @param payload Encoded K-V pairs (see encodePut)
+ * @param sequence set to the sequence number of the record, bigger than that of every record written before it
+ * @return true if the record is written (and synced). Otherwise none of it is in the log.
+ */
+bool WAL::addRecord(const std::string &payload, uint64_t &sequence)
+{
+    std::string record;
+    coding::putFixed32(record, coding::crc32(payload.data(), payload.size()));
+    coding::putFixed32(record, (uint32_t) payload.size());
+    record += payload;
+
+    Writer w(&record);
+    std::unique_lock<std::mutex> lk(lock);
+    sequence = ++lastSequence;
+    writers.push_back(&w);
+    while (!w.done && &w != writers.front())
+        w.cv.wait(lk);
+    if (w.done) return w.ok;
+
+    /* This writer leads: collect the group */
+    Writer *last = &w;
+    std::string group;
+    const std::string *data = &record;
+    if (mode == SYNC_GROUP) {
+        for (Writer *x : writers) {
+            if (x != &w && group.size() + x->record->size() > WAL_GROUP_BYTES) break;
+            group += *x->record;
+            last = x;
+        }
+        data = &group;
+    }
+
+    /* Followers keep queueing while the leader is in write/fsync */
+    lk.unlock();
+    bool ok = writeGroup(*data, mode != SYNC_NONE);
+    lk.lock();
+
+    while (true) {
+        Writer *x = writers.front();
+        writers.pop_front();
+        x->ok = ok;
+        x->done = true;
+        if (x != &w) x->cv.notify_one();
+        if (x == last) break;
+    }
+    /* Wake the leader of the next group */
+    if (!writers.empty()) writers.front()->cv.notify_one();
+    return ok;
+}
+
+/**
+ * @return Sequence number of the last record queued
+ */
+uint64_t WAL::getLastSequence()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    return lastSequence;
+}
+
+/**
+ * @brief Append one K-V pair to a record payload
+ */
+void WAL::encodePut(std::string &payload, uint64_t key, const std::string &val)
+{
+    coding::putVarint64(payload, key);
+    coding::putVarint64(payload, val.size());
+    payload += val;
+}
+
+/**
+ * @brief Read every complete record of a log, stopping at a torn or corrupted tail.
+ * @param ops set to the logged K-V pairs in write order
+ * @return false if the log can not be read.
+ */
+bool WAL::replay(const std::string &path, std::vector<std::pair<uint64_t, std::string>> &ops)
+{
+    std::string content;
+    ops.clear();
+    if (utils::readFile(path.c_str(), content) != 0) return false;
+
+    uint64_t pos = 0;
+    std::vector<std::pair<uint64_t, std::string>> recordOps;
+    while (pos + 8 <= content.size()) {
+        uint32_t crc = coding::decodeFixed32(content.data() + pos);
+        uint32_t len = coding::decodeFixed32(content.data() + pos + 4);
+        if (pos + 8 + len > content.size()) break;
+        const char *p = content.data() + pos + 8;
+        const char *limit = p + len;
+        if (coding::crc32(p, len) != crc) break;
+
+        /* Decode the whole record before applying any of it */
+        bool ok = true;
+        recordOps.clear();
+        while (p < limit) {
+            uint64_t key, valLen;
+            if (!coding::getVarint64(p, limit, key) || !coding::getVarint64(p, limit, valLen)
+                || valLen > (uint64_t) (limit - p)) {
+                ok = false;
+                break;
+            }
+            recordOps.push_back(std::pair<uint64_t, std::string>(key, std::string(p, valLen)));
+            p += valLen;
+        }
+        if (!ok) break;
+        ops.insert(ops.end(), recordOps.begin(), recordOps.end());
+        pos += 8 + len;
+    }
+    return true;
+}
+
+/**
+ * @brief Parse "wal<number>.log"
+ * @return false if name is not a log file.
+ */
+bool WAL::parseNumber(const std::string &name, uint64_t &number)
+{
+    if (name.size() <= 7 || name.compare(0, 3, "wal") != 0 || name.compare(name.size() - 4, 4, ".log") != 0)
+        return false;
+    std::string digits = name.substr(3, name.size() - 7);
+    if (digits.find_first_not_of("0123456789") != std::string::npos) return false;
+    number = strtoull(digits.c_str(), nullptr, 10);
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * When a write-ahead log record is flushed to disk
+ * @param SYNC_NONE Write to the OS only: survives a process crash, not a power loss
+ * @param SYNC_PER_WRITE fsync every record before the write returns
+ * @param SYNC_GROUP fsync before the write returns, one fsync for all writers waiting at that moment
+ */
+enum WALSyncMode
+{
+    SYNC_NONE = 1,
+    SYNC_PER_WRITE,
+    SYNC_GROUP
+};
+
+#define WAL_GROUP_BYTES (1024 * 1024)   //Max bytes the leader of a group commit writes for its followers
+
+/**
+ * Write-ahead log of the MemTable, "dir/wal<number>.log".
+ * Record: [crc32(4)][length(4)][payload], payload is a sequence of
+ * [varint key][varint value length][value] (deletion: value "~DELETE~").
+ * A record is replayed only if it is complete, so all K-V pairs of one record survive a crash or none does.
+ * Every record gets a sequence number in the order the records are written, after those of the logs before it,
+ * so writers that apply their records concurrently can still agree with the log on which write to a key came last.
+ */
+class WAL
+{
+private:
+    /* A write waiting in the group commit queue */
+    struct Writer
+    {
+        const std::string *record;
+        bool done;
+        bool ok;
+        std::condition_variable cv;
+        Writer(const std::string *_record) : record(_record), done(false), ok(false) {}
+    };
+
+    int fd;
+    uint64_t fileBytes;                     //Bytes of the records written so far
+    WALSyncMode mode;
+    std::mutex lock;
+    std::deque<Writer *> writers;           //Front: the leader writing the current group
+    uint64_t lastSequence;                  //Sequence of the last record queued, records are written in this order
+
+    bool writeGroup(const std::string &data, bool sync);
+
+public:
+    WAL(const std::string &path, WALSyncMode _mode, uint64_t sequence);
+
+    ~WAL();
+
+    bool addRecord(const std::string &payload, uint64_t &sequence);
+
+    uint64_t getLastSequence();
+
+    static void encodePut(std::string &payload, uint64_t key, const std::string &val);
+
+    static bool replay(const std::string &path, std::vector<std::pair<uint64_t, std::string>> &ops);
+
+    static std::string fileName(uint64_t number){return "wal" + std::to_string(number) + ".log";}
+
+    static bool parseNumber(const std::string &name, uint64_t &number);
+};
@@ -0,0 +1,24 @@
+#include <algorithm>
+
+#include "writebatch.h"
+
+/**
+ * @brief The operations in ascending key order, one per key (the last one written)
+ * @param sorted set to pointers into the batch, valid until it is changed
+ */
+void WriteBatch::sortedEntries(std::vector<const KVPair *> &sorted)
+{
+    std::vector<const KVPair *> all;
+    all.reserve(entries.size());
+    for (const KVPair &e : entries)
+        all.push_back(&e);
+    std::stable_sort(all.begin(), all.end(), [](const KVPair *a, const KVPair *b) {
+        return a->first < b->first;
+    });
+    sorted.clear();
+    uint64_t size = all.size();
+    for (uint64_t i = 0; i < size; ++i) {
+        if (i + 1 < size && all[i + 1]->first == all[i]->first) continue;
+        sorted.push_back(all[i]);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+typedef std::pair<uint64_t, std::string> KVPair;
+
+/**
+ * Puts and deletions collected in memory and applied by KVStore::write as one unit:
+ * one log record, one overflow check and one ordered pass over the MemTable.
+ * If a key is written more than once, the last operation wins.
+ * The batch is applied atomically: readers running alongside write see all of it or none of it, and so does
+ * recovery after a crash.
+ */
+class WriteBatch
+{
+private:
+    std::vector<KVPair> entries;            //In call order, deletions hold "~DELETE~"
+
+public:
+    void put(uint64_t key, const std::string &val){entries.push_back(KVPair(key, val));}
+
+    void del(uint64_t key){entries.push_back(KVPair(key, "~DELETE~"));}
+
+    void clear(){entries.clear();}
+
+    uint64_t count(){return entries.size();}
+
+    void sortedEntries(std::vector<const KVPair *> &sorted);
+};